@@ -1,3 +1,6 @@
+#ifndef ABUF_H
+#define ABUF_H
+
 #include <stdlib.h>
 
 /* append buffer */
@@ -17,3 +20,5 @@ int ab_strcat(struct abuf *ab, const char *s, unsigned long long len);
 void ab_pop(struct abuf *ab, unsigned long long times);
 
 void ab_free(struct abuf *ab);
+
+#endif
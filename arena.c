@@ -0,0 +1,60 @@
+#include "arena.h"
+#include <stdlib.h>
+#include <string.h>
+
+void arena_init(arena *a) {
+  memset(a, 0, sizeof(*a));
+  a->next = ARENA_SLAB_MIN;
+}
+
+// add a slab of size bytes to a, returning its base or NULL
+static char *arena_slab(arena *a, llong_t size) {
+  if (a->nslabs == a->cap) {
+    llong_t cap = a->cap ? a->cap * 2 : 16;
+    slab *slabs = realloc(a->slabs, sizeof(slab) * cap);
+    if (!slabs)
+      return NULL;
+    a->slabs = slabs;
+    a->cap = cap;
+  }
+  char *base = malloc(size);
+  if (!base)
+    return NULL;
+  a->slabs[a->nslabs].base = base;
+  a->slabs[a->nslabs++].size = size;
+  a->size += size;
+  return base;
+}
+
+// return n bytes from a, which stay valid until a is freed, or NULL
+char *arena_alloc(arena *a, llong_t n) {
+  if (n > a->end - a->at) {
+    // a buffer too big to share a slab gets one of its own, leaving the
+    // current slab to be carved up further
+    if (n > a->next / 4) {
+      char *p = arena_slab(a, n);
+      if (p)
+        a->used += n;
+      return p;
+    }
+    char *base = arena_slab(a, a->next);
+    if (!base)
+      return NULL;
+    a->at = base;
+    a->end = base + a->next;
+    if (a->next < ARENA_SLAB_MAX)
+      a->next *= 2;
+  }
+  char *p = a->at;
+  a->at += n;
+  a->used += n;
+  return p;
+}
+
+// free every buffer handed out by a at once
+void arena_free(arena *a) {
+  for (llong_t i = 0; i < a->nslabs; i++)
+    free(a->slabs[i].base);
+  free(a->slabs);
+  arena_init(a);
+}
@@ -0,0 +1,33 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+#include "row.h"
+
+/* slabs that many small buffers are carved from and freed with at once */
+
+#define ARENA_SLAB_MIN (1 << 20)  // size of the first slab
+#define ARENA_SLAB_MAX (64 << 20) // slabs double in size up to this
+
+typedef struct slab {
+  char *base;   // start of the slab
+  llong_t size; // bytes in the slab
+} slab;
+
+typedef struct arena {
+  slab *slabs;    // every slab allocated, oldest first
+  llong_t nslabs; // number of slabs
+  llong_t cap;    // capacity of slabs
+  char *at;       // next free byte of the slab being carved up
+  char *end;      // end of the slab being carved up
+  llong_t next;   // size of the next slab
+  llong_t used;   // bytes handed out
+  llong_t size;   // bytes in all slabs
+} arena;
+
+void arena_init(arena *a);
+
+char *arena_alloc(arena *a, llong_t n);
+
+void arena_free(arena *a);
+
+#endif
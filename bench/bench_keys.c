@@ -0,0 +1,328 @@
+#define _DEFAULT_SOURCE
+
+#include "../headless.h"
+#include "../save.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* keystroke replay benchmark */
+
+ullong_t allocs; // allocations made so far
+
+// linked with --wrap for these where the linker has it (GNU ld), so that
+// tin's own allocations are counted, or else allocations are not reported
+#ifdef TIN_COUNT_ALLOCS
+void *__real_malloc(size_t n);
+void *__real_calloc(size_t n, size_t size);
+void *__real_realloc(void *p, size_t n);
+
+void *__wrap_malloc(size_t n) {
+  allocs++;
+  return __real_malloc(n);
+}
+
+void *__wrap_calloc(size_t n, size_t size) {
+  allocs++;
+  return __real_calloc(n, size);
+}
+
+void *__wrap_realloc(void *p, size_t n) {
+  allocs++;
+  return __real_realloc(p, n);
+}
+#endif
+
+static llong_t now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000000LL + ts.tv_nsec;
+}
+
+/* corpora */
+
+static const char *words[] = {"the",   "quick", "brown",   "fox",   "jumps",
+                              "over",  "lazy",  "dog",     "lorem", "ipsum",
+                              "dolor", "sit",   "amet",    "data",  "value",
+                              "index", "row",   "render",  "frame", "key"};
+static const char *utf_words[] = {"héllo", "wörld", "日本語", "ёжик",
+                                  "naïve", "café",  "λόγος",  "über"};
+
+#define NWORDS (sizeof(words) / sizeof(*words))
+#define NUTF_WORDS (sizeof(utf_words) / sizeof(*utf_words))
+
+// append words to ab until the line is len bytes or more, using utf-8 words
+// one time in utf, tabs one time in tabs and the search word one time in 50
+static void gen_line(abuf *ab, llong_t len, int utf, int tabs) {
+  llong_t start = ab->len;
+  while ((llong_t)ab->len - start < len) {
+    const char *w = words[rand() % NWORDS];
+    if (utf && rand() % utf == 0)
+      w = utf_words[rand() % NUTF_WORDS];
+    if (rand() % 50 == 0)
+      w = "needle";
+    if (ab->len > (ullong_t)start)
+      ab_charcat(ab, tabs && rand() % tabs == 0 ? '\t' : ' ');
+    ab_strcat(ab, w, strlen(w));
+  }
+  ab_charcat(ab, '\n');
+}
+
+typedef struct corpus {
+  const char *name;
+  llong_t lines;  // number of lines
+  llong_t minlen; // bytes in the shortest line, roughly
+  llong_t maxlen; // bytes in the longest line, roughly
+  int indent;     // set to start lines with up to 4 tabs
+  int tabs;       // one separator in tabs is a tab, or 0 for none
+  int utf;        // one word in utf is utf-8, or 0 for none
+} corpus;
+
+static const corpus corpora[] = {
+    {"long", 2000, 1000, 4000, 0, 0, 0},
+    {"short", 200000, 0, 24, 0, 0, 0},
+    {"tabs", 50000, 10, 80, 1, 3, 0},
+    {"utf8", 50000, 10, 80, 0, 0, 2},
+};
+
+#define NCORPORA (sizeof(corpora) / sizeof(*corpora))
+
+static void gen_corpus(const corpus *c, abuf *ab) {
+  srand(1);
+  for (llong_t i = 0; i < c->lines; i++) {
+    for (int t = c->indent ? rand() % 5 : 0; t > 0; t--)
+      ab_charcat(ab, '\t');
+    gen_line(ab, c->minlen + rand() % (c->maxlen - c->minlen + 1), c->utf,
+             c->tabs);
+  }
+}
+
+/* traces */
+
+#define KEY_UP "\x1b[A"
+#define KEY_DOWN "\x1b[B"
+#define KEY_RIGHT "\x1b[C"
+#define KEY_PGUP "\x1b[5~"
+#define KEY_PGDN "\x1b[6~"
+
+// keys of a trace, each a run of bytes in keys starting at an offset in at
+typedef struct trace {
+  abuf keys;
+  llong_t *at;
+  llong_t n;
+  llong_t cap;
+} trace;
+
+static void add_key(trace *t, const char *key) {
+  if (t->n == t->cap) {
+    t->cap = t->cap ? t->cap * 2 : 256;
+    if (!(t->at = realloc(t->at, sizeof(llong_t) * t->cap))) {
+      perror("realloc");
+      exit(1);
+    }
+  }
+  t->at[t->n++] = t->keys.len;
+  ab_strcat(&t->keys, key, strlen(key));
+}
+
+static void add_keys(trace *t, const char *key, int times) {
+  while (times-- > 0)
+    add_key(t, key);
+}
+
+// type text a byte at a time
+static void add_text(trace *t, const char *s) {
+  char key[2] = "";
+  for (; *s; s++) {
+    key[0] = *s == '\n' ? '\r' : *s;
+    add_key(t, key);
+  }
+}
+
+static void trace_typing(trace *t) {
+  add_keys(t, KEY_DOWN, 20);
+  for (int i = 0; i < 40; i++)
+    add_text(t, "the quick brown fox jumps over the lazy dog\n");
+}
+
+static void trace_paging(trace *t) {
+  add_keys(t, KEY_PGDN, 300);
+  add_keys(t, KEY_PGUP, 150);
+  add_keys(t, KEY_DOWN, 200);
+}
+
+static void trace_searching(trace *t) {
+  add_key(t, "\x06");
+  add_text(t, "needle");
+  add_keys(t, KEY_DOWN, 200);
+  add_key(t, "\r");
+  add_key(t, "\x1b");
+}
+
+// a terminal sends pasted text as fast as it can, with no bracketing
+static void trace_pasting(trace *t) {
+  add_keys(t, KEY_DOWN, 10);
+  abuf text;
+  ab_init(&text);
+  srand(2);
+  for (int i = 0; i < 100; i++)
+    gen_line(&text, 60, 0, 0);
+  ab_charcat(&text, '\0');
+  add_text(t, text.buf);
+  ab_free(&text);
+}
+
+static void trace_saving(trace *t) {
+  for (int i = 0; i < 20; i++) {
+    add_text(t, "edit ");
+    add_key(t, "\x13");
+  }
+}
+
+typedef struct tracer {
+  const char *name;
+  void (*build)(trace *t);
+} tracer;
+
+static const tracer tracers[] = {
+    {"typing", trace_typing},   {"paging", trace_paging},
+    {"searching", trace_searching}, {"pasting", trace_pasting},
+    {"saving", trace_saving},
+};
+
+#define NTRACERS (sizeof(tracers) / sizeof(*tracers))
+
+/* replay */
+
+// a replay of a trace, timing from when each key is read to when the next
+// one is, which takes in handling the key and drawing the frame after it
+typedef struct run {
+  headless h;
+  tin_io inner;   // io reading from and writing to h
+  const trace *t;
+  llong_t next;   // next key of the trace to be read
+  llong_t *ns;    // time each key was read at, and the time the last ended
+  ullong_t *out;  // bytes written before each key was read, and in all
+  ullong_t *mem;  // allocations made before each key was read, and in all
+} run;
+
+static llong_t run_read(void *ctx, char *c) {
+  run *r = ctx;
+  if (r->next < r->t->n && r->h.next == r->t->at[r->next]) {
+    r->out[r->next] = r->h.bytes;
+    r->mem[r->next] = allocs;
+    r->ns[r->next++] = now_ns();
+  }
+  return r->inner.read(r->inner.ctx, c);
+}
+
+static void run_write(void *ctx, const char *buf, llong_t len) {
+  run *r = ctx;
+  r->inner.write(r->inner.ctx, buf, len);
+}
+
+static int run_size(void *ctx, llong_t *rows, llong_t *cols) {
+  run *r = ctx;
+  return r->inner.size(r->inner.ctx, rows, cols);
+}
+
+static int cmp_llong(const void *a, const void *b) {
+  llong_t x = *(const llong_t *)a, y = *(const llong_t *)b;
+  return (x > y) - (x < y);
+}
+
+// replay t against the file fname and print the latency of its keys
+static void replay(const char *corpus, const char *name, const trace *t,
+                   const char *fname) {
+  run r;
+  r.t = t;
+  r.next = 0;
+  r.ns = malloc(sizeof(llong_t) * (t->n + 1));
+  r.out = malloc(sizeof(ullong_t) * (t->n + 1));
+  r.mem = malloc(sizeof(ullong_t) * (t->n + 1));
+  if (!r.ns || !r.out || !r.mem) {
+    perror("malloc");
+    exit(1);
+  }
+  headless_init(&r.h, t->keys.buf, t->keys.len, 24, 80);
+
+  headless_io(&r.h, &r.inner);
+  tin_io io = {&r, -1, run_read, run_write, run_size};
+  tin_opts opts;
+  tin_default_opts(&opts);
+  opts.journal = 0;
+  opts.sync = SAVE_SYNC_NONE; // time tin, not the disk
+
+  tin *ed = tin_new(&io, &opts, fname);
+  tin_draw(ed);
+  while (!headless_done(&r.h) && !tin_key(ed))
+    tin_draw(ed);
+  r.out[t->n] = r.h.bytes;
+  r.mem[t->n] = allocs;
+  r.ns[t->n] = now_ns();
+  tin_free(ed);
+
+  llong_t n = r.next; // keys read, all of them unless tin quit early
+  for (llong_t i = 0; i < n; i++)
+    r.ns[i] = r.ns[i + 1 < n ? i + 1 : t->n] - r.ns[i];
+  ullong_t bytes = r.out[t->n] - r.out[0], mem = r.mem[t->n] - r.mem[0];
+  qsort(r.ns, n, sizeof(llong_t), cmp_llong);
+  printf("%-6s %-10s %6lld %9.1f %9.1f %10.1f %9.0f", corpus, name, n,
+         r.ns[n / 2] / 1e3, r.ns[(n - 1) * 99 / 100] / 1e3, r.ns[n - 1] / 1e3,
+         (double)bytes / n);
+#ifdef TIN_COUNT_ALLOCS
+  printf(" %8.1f\n", (double)mem / n);
+#else
+  (void)mem;
+  printf(" %8s\n", "-");
+#endif
+
+  headless_free(&r.h);
+  free(r.ns);
+  free(r.out);
+  free(r.mem);
+}
+
+int main() {
+  const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+  char fname[4096];
+  snprintf(fname, sizeof(fname), "%s/tin-bench-keys.%d", dir, getpid());
+
+  trace traces[NTRACERS];
+  for (unsigned i = 0; i < NTRACERS; i++) {
+    memset(&traces[i], 0, sizeof(trace));
+    ab_init(&traces[i].keys);
+    tracers[i].build(&traces[i]);
+  }
+
+  printf("replaying keys on a 24x80 screen, latency in us from one key read "
+         "to the next\n");
+  printf("%-6s %-10s %6s %9s %9s %10s %9s %8s\n", "corpus", "trace", "keys",
+         "p50", "p99", "max", "bytes/key", "allocs/key");
+  for (unsigned c = 0; c < NCORPORA; c++) {
+    abuf text;
+    ab_init(&text);
+    gen_corpus(&corpora[c], &text);
+
+    // each trace starts from the corpus as generated
+    for (unsigned i = 0; i < NTRACERS; i++) {
+      FILE *fp = fopen(fname, "w");
+      if (!fp || fwrite(text.buf, 1, text.len, fp) != text.len ||
+          fclose(fp) == EOF) {
+        perror(fname);
+        return 1;
+      }
+      replay(corpora[c].name, tracers[i].name, &traces[i], fname);
+    }
+    ab_free(&text);
+  }
+  unlink(fname);
+
+  for (unsigned i = 0; i < NTRACERS; i++) {
+    ab_free(&traces[i].keys);
+    free(traces[i].at);
+  }
+  return 0;
+}
@@ -0,0 +1,256 @@
+#define _DEFAULT_SOURCE
+
+#include "../headless.h"
+#include "../tin_internal.h"
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+/* micro-benchmarks of tin's innermost loops */
+
+#define MICRO_SAMPLES 21    // timed samples of each benchmark
+#define MICRO_SAMPLE_NS 2e6 // rough length of a sample
+#define MICRO_WARMUP_NS 2e7 // time spent running a benchmark untimed first
+#define MICRO_ROWS 1000     // rows searched per op by the search benchmark
+
+volatile llong_t sink; // results go here so that no work is skipped
+
+static double now_ns() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+/* inputs */
+
+typedef struct input {
+  const char *name;
+  llong_t len; // bytes in a line
+  int tabs;    // one char in tabs is a tab, or 0 for none
+  int utf;     // percent of chars that are 2-byte utf-8
+} input;
+
+static const input inputs[] = {
+    {"16", 16, 0, 0},           {"80", 80, 0, 0},
+    {"80 tabs", 80, 8, 0},      {"80 utf8", 80, 0, 50},
+    {"1000", 1000, 0, 0},       {"1000 tabs", 1000, 8, 0},
+    {"1000 utf8", 1000, 0, 50},
+};
+
+#define NINPUTS (sizeof(inputs) / sizeof(*inputs))
+
+// fill line with in->len bytes of text as in says, ending in a nul byte
+static void gen_line(const input *in, char *line) {
+  static const char letters[] = "abcdefghijklmnopqrstuvwxyz   ";
+  llong_t i = 0;
+  while (i < in->len) {
+    int r = rand() % 100;
+    if (in->tabs && rand() % in->tabs == 0) {
+      line[i++] = '\t';
+    } else if (r < in->utf && i + 2 <= in->len) {
+      line[i++] = (char)0xc3; // é
+      line[i++] = (char)0xa9;
+    } else {
+      line[i++] = letters[rand() % (sizeof(letters) - 1)];
+    }
+  }
+  line[i] = '\0';
+}
+
+/* benchmarks */
+
+// state a benchmark runs on, made once per input
+typedef struct fixture {
+  const input *in;
+  char *line;
+  textrow row;              // the line, rendered
+  textrow rows[MICRO_ROWS]; // lines like it, one in ten holding "needle"
+} fixture;
+
+typedef void (*benchfn)(fixture *f, llong_t n);
+
+// appends start over once a buffer holds about a large frame
+#define MICRO_FRAME (64 << 10)
+
+static void bench_strcat(fixture *f, llong_t n) {
+  abuf ab;
+  ab_init(&ab);
+  for (llong_t i = 0; i < n; i++) {
+    if (ab.len >= MICRO_FRAME)
+      ab.len = 0;
+    ab_strcat(&ab, f->line, f->in->len);
+  }
+  sink += ab.len;
+  ab_free(&ab);
+}
+
+static void bench_charcat(fixture *f, llong_t n) {
+  abuf ab;
+  ab_init(&ab);
+  const char *c = f->line;
+  for (llong_t i = 0; i < n; i++) {
+    if (ab.len >= MICRO_FRAME)
+      ab.len = 0;
+    ab_charcat(&ab, *c);
+    c = *c ? c + 1 : f->line;
+  }
+  sink += ab.len;
+  ab_free(&ab);
+}
+
+static void bench_render_row(fixture *f, llong_t n) {
+  for (llong_t i = 0; i < n; i++)
+    render_row(&f->row);
+  sink += f->row.rlen;
+}
+
+static void bench_cx_to_rx(fixture *f, llong_t n) {
+  for (llong_t i = 0; i < n; i++)
+    sink += cx_to_rx(&f->row, f->row.len);
+}
+
+static void bench_rx_to_cx(fixture *f, llong_t n) {
+  for (llong_t i = 0; i < n; i++)
+    sink += rx_to_cx(&f->row, f->row.rlen);
+}
+
+static void bench_nplaces(fixture *f, llong_t n) {
+  (void)f;
+  llong_t v = 1;
+  for (llong_t i = 0; i < n; i++) {
+    sink += nplaces(v);
+    v = v < 1000000000000000000LL ? v * 7 + i : 1;
+  }
+}
+
+// search MICRO_ROWS rows for a match, as find does row by row
+static void bench_search(fixture *f, llong_t n) {
+  for (llong_t i = 0; i < n; i++) {
+    for (llong_t y = 0; y < MICRO_ROWS; y++) {
+      llong_t len;
+      sink += row_find(&f->rows[y], 0, &len);
+    }
+  }
+}
+
+typedef struct bench {
+  const char *name;
+  benchfn fn;
+  const char *unit; // what an op is
+  int once;         // set if the input makes no difference, to run it once
+} bench;
+
+static const bench benches[] = {
+    {"ab_strcat", bench_strcat, "line", 0},
+    {"ab_charcat", bench_charcat, "char", 0},
+    {"render_row", bench_render_row, "row", 0},
+    {"cx_to_rx", bench_cx_to_rx, "row", 0},
+    {"rx_to_cx", bench_rx_to_cx, "row", 0},
+    {"nplaces", bench_nplaces, "call", 1},
+    {"row_find", bench_search, "1000 rows", 0},
+};
+
+#define NBENCHES (sizeof(benches) / sizeof(*benches))
+
+/* measuring */
+
+static int cmp_double(const void *a, const void *b) {
+  double x = *(const double *)a, y = *(const double *)b;
+  return (x > y) - (x < y);
+}
+
+// run b on f untimed for a while, then time MICRO_SAMPLES samples of enough
+// ops to take about MICRO_SAMPLE_NS each, and print the ns per op
+static void measure(const bench *b, fixture *f) {
+  // double the ops per sample until an eighth of a sample is reached
+  llong_t n = 1;
+  double start;
+  while (1) {
+    start = now_ns();
+    b->fn(f, n);
+    if (now_ns() - start >= MICRO_SAMPLE_NS / 8)
+      break;
+    n *= 2;
+  }
+  n *= 8;
+
+  start = now_ns();
+  while (now_ns() - start < MICRO_WARMUP_NS)
+    b->fn(f, n);
+
+  double ns[MICRO_SAMPLES], mean = 0, var = 0;
+  for (int i = 0; i < MICRO_SAMPLES; i++) {
+    start = now_ns();
+    b->fn(f, n);
+    ns[i] = (now_ns() - start) / n;
+    mean += ns[i] / MICRO_SAMPLES;
+  }
+  for (int i = 0; i < MICRO_SAMPLES; i++)
+    var += (ns[i] - mean) * (ns[i] - mean) / (MICRO_SAMPLES - 1);
+  qsort(ns, MICRO_SAMPLES, sizeof(double), cmp_double);
+  printf("%-10s %-10s %-9s %10.1f %10.1f %10.1f %7.1f%%\n", b->name,
+         f->in->name, b->unit, ns[0], ns[MICRO_SAMPLES / 2], mean,
+         100 * sqrt(var) / mean);
+}
+
+int main(int argc, char **argv) {
+  const char *only = argc > 1 ? argv[1] : NULL; // just the benchmark named
+
+  // an editor for tin's row functions to work in, with nothing to draw to
+  headless h;
+  tin_io io;
+  tin_opts opts;
+  headless_init(&h, "", 0, 24, 80);
+  headless_io(&h, &io);
+  tin_default_opts(&opts);
+  opts.journal = 0;
+  tin *ed = tin_new(&io, &opts, NULL);
+  set_query("needle");
+
+  printf("%d samples of each, in ns per op\n", MICRO_SAMPLES);
+  printf("%-10s %-10s %-9s %10s %10s %10s %8s\n", "bench", "input", "op",
+         "min", "median", "mean", "stddev");
+  for (unsigned i = 0; i < NINPUTS; i++) {
+    fixture *f = calloc(1, sizeof(fixture));
+    if (!f || !(f->line = malloc(inputs[i].len + 1))) {
+      perror("malloc");
+      return 1;
+    }
+    f->in = &inputs[i];
+    srand(1);
+    for (llong_t y = 0; y < MICRO_ROWS; y++) {
+      gen_line(f->in, f->line);
+      if (y % 10 == 0 && f->in->len >= 6)
+        memcpy(&f->line[f->in->len / 2 - 3], "needle", 6);
+      if (row_set(&f->rows[y], f->line, f->in->len) == -1) {
+        perror("row");
+        return 1;
+      }
+      render_row(&f->rows[y]);
+    }
+    gen_line(f->in, f->line);
+    if (row_set(&f->row, f->line, f->in->len) == -1) {
+      perror("row");
+      return 1;
+    }
+    render_row(&f->row);
+
+    for (unsigned b = 0; b < NBENCHES; b++) {
+      if ((!only || !strcmp(only, benches[b].name)) &&
+          (!benches[b].once || !i))
+        measure(&benches[b], f);
+    }
+
+    for (llong_t y = 0; y < MICRO_ROWS; y++)
+      row_free(&f->rows[y]);
+    row_free(&f->row);
+    free(f->line);
+    free(f);
+  }
+
+  tin_free(ed);
+  headless_free(&h);
+  return 0;
+}
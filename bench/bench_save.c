@@ -0,0 +1,95 @@
+#define _DEFAULT_SOURCE
+
+#include "../save.h"
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+/* save throughput benchmark */
+
+#define BENCH_RUNS 5
+
+static double now_secs() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// write rows the way tin used to: one write for each line and newline
+static int save_naive(const char *fname, textrow *rows, llong_t nrows) {
+  FILE *fp = fopen(fname, "w");
+  if (!fp)
+    return -1;
+  int fd = fileno(fp);
+  for (llong_t i = 0; i < nrows; i++) {
+    if (write(fd, row_chars(&rows[i]), rows[i].len) != rows[i].len)
+      return fclose(fp), -1;
+    if (i < nrows - 1 && write(fd, "\n", 1) != 1)
+      return fclose(fp), -1;
+  }
+  return fclose(fp);
+}
+
+static void report(const char *name, double secs, llong_t nrows,
+                   llong_t bytes) {
+  printf("%-8s %8.3f s %12.0f lines/s %10.1f MB/s\n", name, secs,
+         nrows / secs, bytes / secs / 1e6);
+}
+
+int main(int argc, char **argv) {
+  llong_t nrows = argc > 1 ? atoll(argv[1]) : 2000000;
+  llong_t maxlen = argc > 2 ? atoll(argv[2]) : 80;
+  const char *dir = getenv("TMPDIR") ? getenv("TMPDIR") : "/tmp";
+
+  // lines of varying length, like source code or logs
+  textrow *rows = calloc(nrows, sizeof(textrow));
+  llong_t bytes = 0;
+  char *line = malloc(maxlen + 1);
+  srand(1);
+  for (llong_t i = 0; i < nrows; i++) {
+    llong_t len = rand() % (maxlen + 1);
+    for (llong_t j = 0; j < len; j++)
+      line[j] = 'a' + rand() % 26;
+    if (row_set(&rows[i], line, len) == -1) {
+      perror("row");
+      return 1;
+    }
+    bytes += len + 1;
+  }
+  free(line);
+
+  char fname[4096];
+  snprintf(fname, sizeof(fname), "%s/tin-bench-save.%d", dir, getpid());
+  printf("saving %lld lines (%.1f MB) to %s, best of %d\n", nrows, bytes / 1e6,
+         dir, BENCH_RUNS);
+
+  double best_naive = 1e9, best = 1e9;
+  for (int run = 0; run < BENCH_RUNS; run++) {
+    double start = now_secs();
+    if (save_naive(fname, rows, nrows) == -1) {
+      perror("naive save");
+      return 1;
+    }
+    double secs = now_secs() - start;
+    best_naive = secs < best_naive ? secs : best_naive;
+
+    llong_t written;
+    const char *err;
+    start = now_secs();
+    if (save_rows(fname, rows, nrows, NULL, NULL, SAVE_SYNC_NONE, &written,
+                  &err) == -1) {
+      fprintf(stderr, "%s: %s\n", err, strerror(errno));
+      return 1;
+    }
+    secs = now_secs() - start;
+    best = secs < best ? secs : best;
+  }
+  unlink(fname);
+
+  report("write", best_naive, nrows, bytes);
+  report("writev", best, nrows, bytes);
+  return 0;
+}
@@ -0,0 +1,89 @@
+#define _DEFAULT_SOURCE
+
+#include "../headless.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+/* replay a script of keys against tin without a terminal */
+
+#define REPLAY_USAGE "usage: %s [-s rowsxcols] [-f] script [file]\n"
+
+// read the whole of fname into ab
+static int slurp(const char *fname, abuf *ab) {
+  FILE *fp = fopen(fname, "r");
+  if (!fp)
+    return -1;
+  char buf[65536];
+  size_t n;
+  while ((n = fread(buf, 1, sizeof(buf), fp)) > 0) {
+    if (ab_strcat(ab, buf, n) == -1) {
+      fclose(fp);
+      return -1;
+    }
+  }
+  int err = ferror(fp);
+  fclose(fp);
+  return err ? -1 : 0;
+}
+
+int main(int argc, char **argv) {
+  llong_t rows = 24, cols = 80;
+  int every = 0, opt;
+  while ((opt = getopt(argc, argv, "s:f")) != -1) {
+    switch (opt) {
+    case 's':
+      if (sscanf(optarg, "%lldx%lld", &rows, &cols) != 2 || rows < 3 ||
+          cols < 1) {
+        fprintf(stderr, REPLAY_USAGE, argv[0]);
+        return 1;
+      }
+      break;
+    case 'f':
+      every = 1;
+      break;
+    default:
+      fprintf(stderr, REPLAY_USAGE, argv[0]);
+      return 1;
+    }
+  }
+  if (optind >= argc) {
+    fprintf(stderr, REPLAY_USAGE, argv[0]);
+    return 1;
+  }
+
+  abuf script;
+  ab_init(&script);
+  if (slurp(argv[optind], &script) == -1) {
+    perror(argv[optind]);
+    return 1;
+  }
+
+  // keys are always ready, so the script runs as fast as tin handles them
+  headless h;
+  tin_io io;
+  tin_opts opts;
+  headless_init(&h, script.buf, script.len, rows, cols);
+  headless_io(&h, &io);
+  tin_default_opts(&opts);
+  opts.journal = 0; // leave no files behind but those the script saves
+  tin *ed = tin_new(&io, &opts, optind + 1 < argc ? argv[optind + 1] : NULL);
+
+  // write every frame with -f, otherwise just the last one
+  int quit = 0;
+  do {
+    tin_draw(ed);
+    if (every)
+      fwrite(h.frame.buf, 1, h.frame.len, stdout);
+  } while (!headless_done(&h) && !(quit = tin_key(ed)));
+  if (!every && !quit)
+    fwrite(h.frame.buf, 1, h.frame.len, stdout);
+  fprintf(stderr, "%lld keys, %lld frames, %llu bytes written\n", h.next,
+          h.frames, h.bytes);
+
+  tin_free(ed);
+  headless_free(&h);
+  ab_free(&script);
+  return 0;
+}
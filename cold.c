@@ -0,0 +1,57 @@
+#include "cold.h"
+#include "lz.h"
+#include <errno.h>
+#include <stdlib.h>
+#include <string.h>
+
+static ullong_t last_id; // id of the last block packed
+
+// compress len bytes of rows at raw into a new block with no references,
+// made by a single malloc so that free releases it
+// return the block, or NULL if out of memory
+// only called from the editor thread
+coldblock *cold_pack(const char *raw, llong_t len) {
+  coldblock *blk = malloc(sizeof(coldblock) + LZ_BOUND(len));
+  if (!blk)
+    return NULL;
+  blk->plen = lz_compress(raw, len, blk->packed);
+  coldblock *fit = realloc(blk, sizeof(coldblock) + blk->plen);
+  if (fit)
+    blk = fit;
+  blk->id = ++last_id;
+  blk->refs = 0;
+  blk->rawlen = len;
+  return blk;
+}
+
+void coldbuf_init(coldbuf *cb) { memset(cb, 0, sizeof(*cb)); }
+
+// return the nul-terminated chars of a cold row, unpacking its block into cb
+// unless already there, or NULL with errno set
+// the chars stay valid until cb unpacks another block, and blocks are never
+// changed, so threads can read them at once through buffers of their own
+const char *cold_read(const textrow *row, coldbuf *cb) {
+  coldblock *blk = row->data.cold.block;
+  if (cb->id != blk->id) {
+    if (blk->rawlen > cb->cap) {
+      char *buf = realloc(cb->buf, blk->rawlen);
+      if (!buf)
+        return NULL;
+      cb->buf = buf;
+      cb->cap = blk->rawlen;
+    }
+    cb->id = 0;
+    if (lz_decompress(blk->packed, blk->plen, cb->buf, blk->rawlen) !=
+        blk->rawlen) {
+      errno = EIO;
+      return NULL;
+    }
+    cb->id = blk->id;
+  }
+  return &cb->buf[row->data.cold.off];
+}
+
+void coldbuf_free(coldbuf *cb) {
+  free(cb->buf);
+  coldbuf_init(cb);
+}
@@ -0,0 +1,31 @@
+#ifndef COLD_H
+#define COLD_H
+
+#include "row.h"
+
+/* rows packed into compressed blocks while away from the screen */
+
+typedef struct coldblock {
+  ullong_t id;    // tells blocks apart, never reused
+  llong_t refs;   // rows still read from the block
+  llong_t rawlen; // bytes of the rows' chars, each followed by a nul byte
+  llong_t plen;   // bytes of packed
+  char packed[];  // the rows' chars back to back, compressed
+} coldblock;
+
+// a block unpacked for reading its rows
+typedef struct coldbuf {
+  ullong_t id;  // block held in buf, or 0
+  char *buf;    // the block's rows
+  llong_t cap;  // capacity of buf
+} coldbuf;
+
+coldblock *cold_pack(const char *raw, llong_t len);
+
+void coldbuf_init(coldbuf *cb);
+
+const char *cold_read(const textrow *row, coldbuf *cb);
+
+void coldbuf_free(coldbuf *cb);
+
+#endif
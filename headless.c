@@ -0,0 +1,57 @@
+#include "headless.h"
+#include <string.h>
+
+#define ESC_SEQ "\x1b["
+
+void headless_init(headless *h, const char *keys, llong_t nkeys, llong_t rows,
+                   llong_t cols) {
+  h->keys = keys;
+  h->nkeys = nkeys;
+  h->next = 0;
+  h->rows = rows;
+  h->cols = cols;
+  ab_init(&h->frame);
+  h->frames = 0;
+  h->bytes = 0;
+}
+
+// read the next byte of the script
+// once it runs out, read ESC so that any prompt still open is cancelled
+static llong_t headless_read(void *ctx, char *c) {
+  headless *h = ctx;
+  *c = h->next < h->nkeys ? h->keys[h->next++] : '\x1b';
+  return 1;
+}
+
+// keep what is written from the start of the last frame, which begins by
+// hiding the cursor
+static void headless_write(void *ctx, const char *buf, llong_t len) {
+  headless *h = ctx;
+  if (len >= 6 && !memcmp(buf, ESC_SEQ "?25l", 6)) {
+    h->frame.len = 0;
+    h->frames++;
+  }
+  ab_strcat(&h->frame, buf, len);
+  h->bytes += len;
+}
+
+static int headless_size(void *ctx, llong_t *rows, llong_t *cols) {
+  headless *h = ctx;
+  *rows = h->rows;
+  *cols = h->cols;
+  return 0;
+}
+
+// set io to drive an editor from h
+void headless_io(headless *h, tin_io *io) {
+  io->ctx = h;
+  io->fd = -1;
+  io->read = headless_read;
+  io->write = headless_write;
+  io->size = headless_size;
+}
+
+// return nonzero once every key of the script has been read
+int headless_done(const headless *h) { return h->next >= h->nkeys; }
+
+void headless_free(headless *h) { ab_free(&h->frame); }
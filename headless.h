@@ -0,0 +1,29 @@
+#ifndef HEADLESS_H
+#define HEADLESS_H
+
+#include "abuf.h"
+#include "tin.h"
+
+/* driving an editor from a script of keys, without a terminal */
+
+typedef struct headless {
+  const char *keys; // bytes of the script, as a terminal would send them
+  llong_t nkeys;    // bytes in keys
+  llong_t next;     // next byte of keys to read
+  llong_t rows;     // size of the screen
+  llong_t cols;
+  abuf frame;       // output since the last frame began
+  llong_t frames;   // frames written
+  ullong_t bytes;   // bytes written in all
+} headless;
+
+void headless_init(headless *h, const char *keys, llong_t nkeys, llong_t rows,
+                   llong_t cols);
+
+void headless_io(headless *h, tin_io *io);
+
+int headless_done(const headless *h);
+
+void headless_free(headless *h);
+
+#endif
@@ -0,0 +1,53 @@
+#include "intern.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define INTERN_MIN_SLOTS 1024
+
+void intern_init(interns *t) { memset(t, 0, sizeof(*t)); }
+
+// double the number of slots, keeping every string
+// return 0, or -1 if out of memory
+static int intern_grow(interns *t) {
+  llong_t cap = t->cap ? t->cap * 2 : INTERN_MIN_SLOTS;
+  internslot *slots = calloc(cap, sizeof(internslot));
+  if (!slots)
+    return -1;
+  for (llong_t i = 0; i < t->cap; i++) {
+    if (!t->slots[i].s)
+      continue;
+    llong_t j = t->slots[i].hash & (cap - 1);
+    while (slots[j].s)
+      j = (j + 1) & (cap - 1);
+    slots[j] = t->slots[i];
+  }
+  free(t->slots);
+  t->slots = slots;
+  t->cap = cap;
+  return 0;
+}
+
+// return where the len bytes at s, whose hash is given, are stored in t
+// if t holds no such string the slot returned is claimed for it and points
+// at NULL, and the caller must store a pointer to a lasting copy of s there
+// return NULL if out of memory
+char **intern_slot(interns *t, const char *s, llong_t len, ullong_t hash) {
+  if (2 * (t->n + 1) > t->cap && intern_grow(t) == -1)
+    return NULL;
+  unsigned h = (unsigned)hash;
+  llong_t i = h & (t->cap - 1);
+  for (; t->slots[i].s; i = (i + 1) & (t->cap - 1)) {
+    internslot *slot = &t->slots[i];
+    if (slot->hash == h && slot->len == len && !memcmp(slot->s, s, len))
+      return &slot->s;
+  }
+  t->slots[i].len = len;
+  t->slots[i].hash = h;
+  t->n++;
+  return &t->slots[i].s;
+}
+
+void intern_free(interns *t) {
+  free(t->slots);
+  intern_init(t);
+}
@@ -0,0 +1,26 @@
+#ifndef INTERN_H
+#define INTERN_H
+
+#include "row.h"
+
+/* a set of byte strings, so that identical rows can share one copy */
+
+typedef struct internslot {
+  char *s;       // stored bytes, or NULL if the slot is free
+  unsigned len;  // number of bytes at s
+  unsigned hash; // low bits of the hash of the bytes
+} internslot;
+
+typedef struct interns {
+  internslot *slots; // open addressing table
+  llong_t cap;       // number of slots, a power of two
+  llong_t n;         // number of slots in use
+} interns;
+
+void intern_init(interns *t);
+
+char **intern_slot(interns *t, const char *s, llong_t len, ullong_t hash);
+
+void intern_free(interns *t);
+
+#endif
@@ -0,0 +1,284 @@
+#include "journal.h"
+#include "undo.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define JOURNAL_MAGIC "TINJRNL2"
+#define JOURNAL_HEADER_LEN (8 + 8 + 8)      // magic, size, mtime in ns
+#define JOURNAL_RECORD_LEN (1 + 8 + 8 + 8)  // kind, y, x, len
+#define JOURNAL_FLUSH_MS 100 // max delay before an edit is written
+#define JOURNAL_SYNC_MS 1000 // max delay before an edit is on disk
+
+void journal_init(journal *j) {
+  j->fd = -1;
+  j->path = NULL;
+  ab_init(&j->pending);
+  j->reset = j->restamp = j->stop = 0;
+  j->size = 0;
+  j->mtime_ns = 0;
+}
+
+static int write_all(int fd, const char *buf, unsigned long long len) {
+  while (len) {
+    ssize_t n = write(fd, buf, len);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1)
+      return -1;
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+static int write_header(int fd, unsigned long long size,
+                        long long mtime_ns) {
+  char hdr[JOURNAL_HEADER_LEN];
+  memcpy(hdr, JOURNAL_MAGIC, 8);
+  memcpy(&hdr[8], &size, 8);
+  memcpy(&hdr[16], &mtime_ns, 8);
+  return write_all(fd, hdr, sizeof(hdr));
+}
+
+// write pending edits in batches, syncing them to disk periodically
+// the editor only ever holds the lock long enough to append to pending
+static void *journal_writer(void *arg) {
+  journal *j = arg;
+  abuf out;
+  ab_init(&out);
+  int unsynced = 0;
+  struct timespec last_sync;
+  clock_gettime(CLOCK_MONOTONIC, &last_sync);
+
+  pthread_mutex_lock(&j->lock);
+  while (1) {
+    if (!j->stop && !j->reset) {
+      struct timespec until;
+      clock_gettime(CLOCK_REALTIME, &until);
+      until.tv_nsec += JOURNAL_FLUSH_MS * 1000000L;
+      until.tv_sec += until.tv_nsec / 1000000000L;
+      until.tv_nsec %= 1000000000L;
+      pthread_cond_timedwait(&j->wake, &j->lock, &until);
+    }
+
+    // take the pending edits, leaving an empty buffer in their place
+    abuf tmp = out;
+    out = j->pending;
+    j->pending = tmp;
+    j->pending.len = 0;
+    int reset = j->reset, restamp = j->restamp, stop = j->stop;
+    unsigned long long size = j->size;
+    long long mtime_ns = j->mtime_ns;
+    j->reset = j->restamp = 0;
+    pthread_mutex_unlock(&j->lock);
+
+    if (reset) {
+      if (ftruncate(j->fd, 0) == 0)
+        write_header(j->fd, size, mtime_ns);
+      unsynced = 1;
+    }
+    if (out.len) {
+      write_all(j->fd, out.buf, out.len);
+      out.len = 0;
+      unsynced = 1;
+    }
+
+    // j->fd appends, so the header is rewritten through a descriptor of its
+    // own, after the edits made before the target grew
+    if (restamp && !reset) {
+      int fd = open(j->path, O_WRONLY);
+      if (fd != -1) {
+        write_header(fd, size, mtime_ns);
+        close(fd);
+      }
+      unsynced = 1;
+    }
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    long long ms = (now.tv_sec - last_sync.tv_sec) * 1000 +
+                   (now.tv_nsec - last_sync.tv_nsec) / 1000000;
+    if (unsynced && (stop || ms >= JOURNAL_SYNC_MS)) {
+      fdatasync(j->fd);
+      unsynced = 0;
+      last_sync = now;
+    }
+    if (stop)
+      break;
+
+    pthread_mutex_lock(&j->lock);
+  }
+
+  ab_free(&out);
+  return NULL;
+}
+
+// start journaling edits to a target file of the given size and mtime (in ns)
+// if keep is set, edits already in the journal are kept
+int journal_open(journal *j, const char *path, unsigned long long size,
+                 long long mtime_ns, int keep) {
+  int flags = O_WRONLY | O_CREAT | O_APPEND | (keep ? 0 : O_TRUNC);
+  int fd = open(path, flags, S_IRUSR | S_IWUSR);
+  if (fd == -1)
+    return -1;
+  if ((!keep || lseek(fd, 0, SEEK_END) == 0) &&
+      write_header(fd, size, mtime_ns) == -1) {
+    close(fd);
+    return -1;
+  }
+
+  j->fd = fd;
+  j->path = strdup(path);
+  j->size = size;
+  j->mtime_ns = mtime_ns;
+  j->reset = j->restamp = j->stop = 0;
+  pthread_mutex_init(&j->lock, NULL);
+  pthread_cond_init(&j->wake, NULL);
+  if (pthread_create(&j->thread, NULL, journal_writer, j) != 0) {
+    close(fd);
+    free(j->path);
+    journal_init(j);
+    return -1;
+  }
+  return 0;
+}
+
+// queue an edit of len bytes of s at (y, x) for writing
+// kind is UNDO_INSERT or UNDO_DELETE; deletions only record their length
+void journal_edit(journal *j, int kind, long long y, long long x,
+                  const char *s, unsigned long long len) {
+  if (j->fd == -1)
+    return;
+  char rec[JOURNAL_RECORD_LEN];
+  rec[0] = kind;
+  memcpy(&rec[1], &y, 8);
+  memcpy(&rec[9], &x, 8);
+  memcpy(&rec[17], &len, 8);
+
+  pthread_mutex_lock(&j->lock);
+  ab_strcat(&j->pending, rec, sizeof(rec));
+  if (kind == UNDO_INSERT)
+    ab_strcat(&j->pending, s, len);
+  pthread_mutex_unlock(&j->lock);
+}
+
+// discard journaled edits, e.g. once they have been saved to the target
+void journal_reset(journal *j, unsigned long long size,
+                   long long mtime_ns) {
+  if (j->fd == -1)
+    return;
+  pthread_mutex_lock(&j->lock);
+  j->pending.len = 0;
+  j->reset = 1;
+  j->size = size;
+  j->mtime_ns = mtime_ns;
+  pthread_cond_signal(&j->wake);
+  pthread_mutex_unlock(&j->lock);
+}
+
+// note that the target grew to size and mtime (in ns) without the journaled
+// edits being saved, e.g. by appends after them, so they still apply to it
+void journal_restamp(journal *j, unsigned long long size,
+                     long long mtime_ns) {
+  if (j->fd == -1)
+    return;
+  pthread_mutex_lock(&j->lock);
+  j->restamp = 1;
+  j->size = size;
+  j->mtime_ns = mtime_ns;
+  pthread_mutex_unlock(&j->lock);
+}
+
+// flush pending edits and stop journaling, removing the journal if asked
+void journal_close(journal *j, int remove) {
+  if (j->fd == -1)
+    return;
+  pthread_mutex_lock(&j->lock);
+  j->stop = 1;
+  pthread_cond_signal(&j->wake);
+  pthread_mutex_unlock(&j->lock);
+  pthread_join(j->thread, NULL);
+
+  close(j->fd);
+  if (remove)
+    unlink(j->path);
+  free(j->path);
+  ab_free(&j->pending);
+  pthread_mutex_destroy(&j->lock);
+  pthread_cond_destroy(&j->wake);
+  journal_init(j);
+}
+
+// return nonzero if the journal at path holds any edits
+int journal_has_edits(const char *path) {
+  struct stat st;
+  return stat(path, &st) == 0 && st.st_size > JOURNAL_HEADER_LEN;
+}
+
+// apply every complete edit in the journal at path, if it was started for a
+// target of the given size and mtime (in ns), stopping at the first one that
+// apply turns down by returning -1
+// return the number of edits applied, or -1 if there is no usable journal
+long long journal_replay(const char *path, unsigned long long size,
+                         long long mtime_ns,
+                         int (*apply)(int, long long, long long, const char *,
+                                      unsigned long long)) {
+  FILE *fp = fopen(path, "r");
+  if (!fp)
+    return -1;
+
+  char hdr[JOURNAL_HEADER_LEN];
+  unsigned long long jsize;
+  long long jmtime_ns;
+  if (fread(hdr, 1, sizeof(hdr), fp) != sizeof(hdr) ||
+      memcmp(hdr, JOURNAL_MAGIC, 8) != 0) {
+    fclose(fp);
+    return -1;
+  }
+  memcpy(&jsize, &hdr[8], 8);
+  memcpy(&jmtime_ns, &hdr[16], 8);
+  if (jsize != size || jmtime_ns != mtime_ns) {
+    fclose(fp);
+    return -1;
+  }
+
+  long long n = 0;
+  char rec[JOURNAL_RECORD_LEN];
+  abuf text;
+  ab_init(&text);
+  while (fread(rec, 1, sizeof(rec), fp) == sizeof(rec)) {
+    long long y, x;
+    unsigned long long len;
+    memcpy(&y, &rec[1], 8);
+    memcpy(&x, &rec[9], 8);
+    memcpy(&len, &rec[17], 8);
+
+    text.len = 0;
+    if (rec[0] == UNDO_INSERT) {
+      if (ab_strcat(&text, "", 0) == -1)
+        break;
+      while (text.len < len) {
+        char buf[4096];
+        unsigned long long want = len - text.len;
+        if (want > sizeof(buf))
+          want = sizeof(buf);
+        if (fread(buf, 1, want, fp) != want)
+          goto done; // edit was cut short by the crash
+        ab_strcat(&text, buf, want);
+      }
+    }
+    if (apply(rec[0], y, x, text.buf, len) == -1)
+      break; // torn, or written against other text
+    n++;
+  }
+
+done:
+  ab_free(&text);
+  fclose(fp);
+  return n;
+}
@@ -0,0 +1,46 @@
+#ifndef JOURNAL_H
+#define JOURNAL_H
+
+#include "abuf.h"
+#include <pthread.h>
+
+/* crash recovery journal */
+
+typedef struct journal {
+  int fd;                  // journal file opened with O_APPEND, or -1
+  char *path;              // journal file path
+  pthread_t thread;        // background writer
+  pthread_mutex_t lock;    // guards everything below
+  pthread_cond_t wake;     // signalled on reset and stop
+  abuf pending;            // encoded edits waiting to be written
+  int reset;               // truncate the journal before the next write
+  int restamp;             // rewrite the header, keeping the edits
+  int stop;                // flush pending edits and exit the writer
+  unsigned long long size; // size of the target file the edits apply to
+  long long mtime_ns;      // mtime in ns of the target file the edits apply to
+} journal;
+
+void journal_init(journal *j);
+
+int journal_open(journal *j, const char *path, unsigned long long size,
+                 long long mtime_ns, int keep);
+
+void journal_edit(journal *j, int kind, long long y, long long x,
+                  const char *s, unsigned long long len);
+
+void journal_reset(journal *j, unsigned long long size,
+                   long long mtime_ns);
+
+void journal_restamp(journal *j, unsigned long long size,
+                     long long mtime_ns);
+
+void journal_close(journal *j, int remove);
+
+int journal_has_edits(const char *path);
+
+long long journal_replay(const char *path, unsigned long long size,
+                         long long mtime_ns,
+                         int (*apply)(int, long long, long long, const char *,
+                                      unsigned long long));
+
+#endif
@@ -0,0 +1,146 @@
+#include "lz.h"
+#include <stdint.h>
+#include <string.h>
+
+// a block is a run of sequences, each a token byte holding a literal count
+// in its high nibble and a match length less LZ_MIN_MATCH in its low one,
+// then the rest of the literal count if the nibble is 15, the literals, a
+// two byte little endian offset back to the match and the rest of the match
+// length if that nibble is 15
+// counts go on in bytes of 255 until one is less, and the last sequence has
+// literals only
+
+typedef long long llong_t;
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_OFFSET 65535
+#define LZ_HASH_BITS 14
+
+static uint32_t read32(const char *p) {
+  uint32_t v;
+  memcpy(&v, p, sizeof(v));
+  return v;
+}
+
+static unsigned hash32(uint32_t v) {
+  return (v * 2654435761u) >> (32 - LZ_HASH_BITS);
+}
+
+// write the part of a count of at least 15 that its nibble cannot hold
+static char *put_count(char *op, llong_t n) {
+  for (n -= 15; n >= 255; n -= 255)
+    *op++ = (char)255;
+  *op++ = (char)n;
+  return op;
+}
+
+// write a sequence of lit literals at from, followed by a match mlen long
+// off bytes back unless mlen is 0
+static char *put_seq(char *op, const char *from, llong_t lit, llong_t off,
+                     llong_t mlen) {
+  llong_t m = mlen ? mlen - LZ_MIN_MATCH : 0;
+  *op++ = (char)((lit < 15 ? lit : 15) << 4 | (m < 15 ? m : 15));
+  if (lit >= 15)
+    op = put_count(op, lit);
+  memcpy(op, from, lit);
+  op += lit;
+  if (!mlen)
+    return op;
+  *op++ = (char)(off & 0xff);
+  *op++ = (char)(off >> 8);
+  if (m >= 15)
+    op = put_count(op, m);
+  return op;
+}
+
+// compress n bytes at src, less than 4 GB, into dst, which must have room
+// for LZ_BOUND(n) bytes, and return the number of bytes written
+// matches are found through a table of the last place each hashed 4 bytes
+// were seen, stepping faster through data that keeps failing to match
+llong_t lz_compress(const char *src, llong_t n, char *dst) {
+  uint32_t table[1 << LZ_HASH_BITS]; // offset + 1 of each hash, 0 if unseen
+  memset(table, 0, sizeof(table));
+
+  const char *ip = src, *anchor = src, *end = src + n;
+  const char *limit = n >= LZ_MIN_MATCH ? end - LZ_MIN_MATCH : src;
+  char *op = dst;
+  unsigned misses = 0;
+  while (ip < limit) {
+    uint32_t v = read32(ip);
+    unsigned h = hash32(v);
+    const char *ref = table[h] ? src + table[h] - 1 : NULL;
+    int found = ref && ip - ref <= LZ_MAX_OFFSET && read32(ref) == v;
+    table[h] = ip - src + 1;
+    if (!found) {
+      ip += 1 + (misses++ >> 6);
+      continue;
+    }
+    misses = 0;
+
+    const char *m = ip + LZ_MIN_MATCH, *r = ref + LZ_MIN_MATCH;
+    while (m < end && *m == *r) {
+      m++;
+      r++;
+    }
+    op = put_seq(op, anchor, ip - anchor, ip - ref, m - ip);
+    ip = anchor = m;
+  }
+  return put_seq(op, anchor, end - anchor, 0, 0) - dst;
+}
+
+// read a count whose nibble was 15 onto *n, returning the input after it or
+// NULL if the input ends first
+static const unsigned char *get_count(const unsigned char *ip,
+                                      const unsigned char *end, llong_t *n) {
+  unsigned char b;
+  do {
+    if (ip == end)
+      return NULL;
+    b = *ip++;
+    *n += b;
+  } while (b == 255);
+  return ip;
+}
+
+// decompress the n bytes at src into dst, which holds cap bytes
+// return the number of bytes written, or -1 if src is not a whole block or
+// would overflow dst
+llong_t lz_decompress(const char *src, llong_t n, char *dst, llong_t cap) {
+  const unsigned char *ip = (const unsigned char *)src, *end = ip + n;
+  char *op = dst, *oend = dst + cap;
+  while (ip < end) {
+    unsigned token = *ip++;
+    llong_t lit = token >> 4;
+    if (lit == 15 && !(ip = get_count(ip, end, &lit)))
+      return -1;
+    if (lit > end - ip || lit > oend - op)
+      return -1;
+    memcpy(op, ip, lit);
+    op += lit;
+    ip += lit;
+    if (ip == end)
+      break; // the last sequence has no match
+
+    if (end - ip < 2)
+      return -1;
+    llong_t off = ip[0] | ip[1] << 8;
+    ip += 2;
+    llong_t mlen = token & 15;
+    if (mlen == 15 && !(ip = get_count(ip, end, &mlen)))
+      return -1;
+    mlen += LZ_MIN_MATCH;
+    if (!off || off > op - dst || mlen > oend - op)
+      return -1;
+
+    // a match may overlap the bytes it produces, repeating them
+    const char *r = op - off;
+    if (off >= mlen) {
+      memcpy(op, r, mlen);
+      op += mlen;
+    } else {
+      while (mlen--)
+        *op++ = *r++;
+    }
+  }
+  return op - dst;
+}
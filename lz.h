@@ -0,0 +1,14 @@
+#ifndef LZ_H
+#define LZ_H
+
+/* fast LZ77 compression of byte blocks, in the manner of LZ4 */
+
+// bytes lz_compress may write for n bytes of input
+#define LZ_BOUND(n) ((n) + (n) / 255 + 16)
+
+long long lz_compress(const char *src, long long n, char *dst);
+
+long long lz_decompress(const char *src, long long n, char *dst,
+                        long long cap);
+
+#endif
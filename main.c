@@ -0,0 +1,199 @@
+#define _DEFAULT_SOURCE
+#define _BSD_SOURCE
+#define _GNU_SOURCE
+
+#include "save.h"
+#include "tin.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <getopt.h>
+#include <locale.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <termios.h>
+#include <unistd.h>
+
+/* tin in a terminal */
+
+#define ESC_SEQ "\x1b["
+#define TIN_USAGE                                                             \
+  "usage: %s [-a secs] [-d none|data|dir] [-f] [-R] [--dedup] [--stats]\n"   \
+  "           [file | -]\n"
+
+struct termios orig_tty; // terminal settings to restore on exit
+tin *ed;                 // the editor running in the terminal
+
+/* terminal i/o */
+
+llong_t tty_read(void *ctx, char *c) {
+  (void)ctx;
+  return read(STDIN_FILENO, c, 1);
+}
+
+void tty_write(void *ctx, const char *buf, llong_t len) {
+  (void)ctx;
+  write(STDOUT_FILENO, buf, len);
+}
+
+// set rows, cols to current cursor position
+int cursor_pos(llong_t *rows, llong_t *cols) {
+  if (write(STDOUT_FILENO, ESC_SEQ "6n", 4) != 4)
+    return -1;
+
+  char buf[64] = "";
+  for (unsigned int i = 0; i < sizeof(buf) - 1; i++) {
+    if (read(STDIN_FILENO, &buf[i], 1) != 1)
+      break;
+    if (buf[i] == 'R')
+      break;
+  }
+
+  // response is of the form: <ESC_SEQ>row;colR
+  // see https://vt100.net/docs/vt100-ug/chapter3.html#CPR
+  if (buf[0] != ESC_SEQ[0] || buf[1] != ESC_SEQ[1])
+    return -1;
+  if (sscanf(&buf[2], "%lld;%lld", rows, cols) != 2)
+    return -1;
+
+  return 0;
+}
+
+// try to get window size using ioctl first
+// otherwise, move cursor to bottom right and get position
+int tty_size(void *ctx, llong_t *rows, llong_t *cols) {
+  (void)ctx;
+  struct winsize ws;
+  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
+    // try to check window size by moving cursor to bottom right
+    if (write(STDOUT_FILENO, ESC_SEQ "999C" ESC_SEQ "999B", 12) != 12)
+      return -1;
+    return cursor_pos(rows, cols);
+  } else {
+    *rows = ws.ws_row;
+    *cols = ws.ws_col;
+  }
+  return 0;
+}
+
+/* tty control */
+
+void disable_raw_tty() {
+  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &orig_tty) == -1)
+    perror("tcsetattr");
+}
+
+void enable_raw_tty() {
+  if (tcgetattr(STDIN_FILENO, &orig_tty) == -1) {
+    perror("tcgetattr");
+    exit(1);
+  }
+
+  atexit(disable_raw_tty);
+  struct termios tty = orig_tty;
+
+  // input flags
+  tty.c_iflag &= ~IXON;   // fix ^S, ^Q
+  tty.c_iflag &= ~ICRNL;  // fix ^M (CR)
+  tty.c_iflag &= ~BRKINT; // breaks still send SIGINT
+  tty.c_iflag &= ~INPCK;  // disable parity checking
+  tty.c_iflag &= ~ISTRIP; // disable stripping of 8th bit
+
+  // output flags
+  tty.c_oflag &= ~OPOST; // disable output processing
+
+  // control flags and chars
+  tty.c_cflag |= CS8;  // 8-bit chars
+  tty.c_cc[VMIN] = 0;  // min bytes to read before returning
+  tty.c_cc[VTIME] = 1; // time to wait for min bytes (* 0.1s)
+
+  // local flags
+  tty.c_lflag &= ~ECHO;   // disable character echo
+  tty.c_lflag &= ~ICANON; // disable canonical mode (line buffering)
+  tty.c_lflag &= ~IEXTEN; // fix ^V, ^O
+  tty.c_lflag &= ~ISIG;   // fix ^C, ^Z
+
+  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &tty) == -1) {
+    perror("tcsetattr");
+    exit(1);
+  }
+}
+
+/* run loop */
+
+void handle_winch() { tin_resize(ed); }
+
+int main(int argc, char **argv) {
+  tin_opts opts;
+  tin_default_opts(&opts);
+  int opt, stats = 0;
+  struct option longopts[] = {{"dedup", no_argument, &opts.dedup, 1},
+                              {"stats", no_argument, &stats, 1},
+                              {0}};
+  while ((opt = getopt_long(argc, argv, "a:d:fR", longopts, NULL)) != -1) {
+    switch (opt) {
+    case 0: // long option that sets a flag
+      break;
+    case 'a':
+      opts.autosave_secs = atoi(optarg);
+      break;
+    case 'f':
+      opts.follow = 1;
+      break;
+    case 'R':
+      opts.page = 1;
+      break;
+    case 'd':
+      for (opts.sync = SAVE_SYNC_DIR; opts.sync >= 0; opts.sync--)
+        if (!strcmp(optarg, sync_names[opts.sync]))
+          break;
+      if (opts.sync < 0) {
+        fprintf(stderr, TIN_USAGE, argv[0]);
+        return 1;
+      }
+      break;
+    default:
+      fprintf(stderr, TIN_USAGE, argv[0]);
+      return 1;
+    }
+  }
+
+  // read piped input in the background and take keys from the terminal
+  const char *fname = optind < argc ? argv[optind] : NULL;
+  if (fname && !strcmp(fname, "-")) {
+    int tty = open("/dev/tty", O_RDWR);
+    if (tty == -1 || (opts.piped = dup(STDIN_FILENO)) == -1 ||
+        dup2(tty, STDIN_FILENO) == -1) {
+      perror("/dev/tty");
+      return 1;
+    }
+    close(tty);
+    fname = NULL;
+  }
+
+  opts.trace = getenv("TIN_TRACE"); // e.g. to load in chrome://tracing
+
+  setlocale(LC_CTYPE, ""); // for unicode case folding in search
+  enable_raw_tty();
+  tin_io io = {NULL, STDIN_FILENO, tty_read, tty_write, tty_size};
+  ed = tin_new(&io, &opts, fname);
+
+  // handle terminal resize
+  struct sigaction sa;
+  sa.sa_handler = handle_winch;
+  sa.sa_flags = SA_RESTART; // restart interrupted syscalls
+  sigemptyset(&sa.sa_mask);
+  sigaction(SIGWINCH, &sa, NULL);
+
+  do
+    tin_draw(ed);
+  while (!tin_key(ed));
+
+  // print memory use once the terminal is back to normal
+  disable_raw_tty();
+  if (stats)
+    tin_stats(ed, stderr);
+  return 0;
+}
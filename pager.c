@@ -0,0 +1,277 @@
+#define _GNU_SOURCE
+
+#include "pager.h"
+#include "search.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+void pager_init(pager *p) {
+  memset(p, 0, sizeof(*p));
+  p->fd = -1;
+}
+
+// open fname for paging without reading any of it yet
+// return 0, or -1 with errno set
+int pager_open(pager *p, const char *fname) {
+  pager_init(p);
+  p->buf = malloc(PAGER_CHUNK);
+  p->marks = malloc(sizeof(llong_t) * 64);
+  if (!p->buf || !p->marks) {
+    pager_close(p);
+    errno = ENOMEM;
+    return -1;
+  }
+  p->markcap = 64;
+  p->marks[p->nmarks++] = 0; // line 0 starts the file
+
+  if ((p->fd = open(fname, O_RDONLY)) == -1) {
+    int saved = errno;
+    pager_close(p);
+    errno = saved;
+    return -1;
+  }
+  return 0;
+}
+
+// return the number of lines known so far, counting a last line that has no
+// newline once the scan has reached the end of the file
+static llong_t pager_lines(pager *p) {
+  return p->nlines + (p->done && p->linepos < p->scanned);
+}
+
+// scan the file for newlines until at least want lines are known or the end
+// is reached, recording the offset of every PAGER_STRIDE-th line
+// return the number of lines known
+llong_t pager_scan(pager *p, llong_t want) {
+  while (!p->done && pager_lines(p) < want) {
+    ssize_t n = pread(p->fd, p->buf, PAGER_CHUNK, p->scanned);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      p->done = 1;
+      break;
+    }
+
+    char *at = p->buf, *end = p->buf + n;
+    char *nl;
+    while ((nl = memchr(at, '\n', end - at))) {
+      p->nlines++;
+      p->linepos = p->scanned + (nl - p->buf) + 1;
+      if (p->nlines % PAGER_STRIDE == 0) {
+        if (p->nmarks == p->markcap) {
+          llong_t cap = p->markcap * 2;
+          llong_t *marks = realloc(p->marks, sizeof(llong_t) * cap);
+          if (!marks) {
+            p->done = 1; // stop growing rather than lose track of lines
+            return pager_lines(p);
+          }
+          p->marks = marks;
+          p->markcap = cap;
+        }
+        p->marks[p->nmarks++] = p->linepos;
+      }
+      at = nl + 1;
+    }
+    p->scanned += n;
+  }
+  return pager_lines(p);
+}
+
+// free the rows in the window
+static void pager_drop(pager *p) {
+  for (llong_t i = 0; i < p->nrows; i++)
+    row_free(&p->rows[i]);
+  p->nrows = 0;
+}
+
+// append the line in chars to the window, taking ownership of chars
+static void pager_emit(pager *p, char *chars, llong_t len) {
+  while (len > 0 && chars[len - 1] == '\r')
+    len--;
+  chars[len] = '\0';
+
+  textrow *row = &p->rows[p->nrows++];
+  memset(row, 0, sizeof(*row));
+  row_adopt(row, chars, len);
+  row->orig = -1;
+}
+
+// decode up to PAGER_WINDOW lines starting at line s into the window, reading
+// forward from the nearest indexed offset before it
+static int pager_fill(pager *p, llong_t s) {
+  pager_drop(p);
+  if (!p->rows && !(p->rows = malloc(sizeof(textrow) * PAGER_WINDOW)))
+    return -1;
+  p->first = s;
+
+  llong_t k = s / PAGER_STRIDE;
+  llong_t line = k * PAGER_STRIDE, off = p->marks[k];
+  llong_t end = s + PAGER_WINDOW;
+  if (end > pager_lines(p))
+    end = pager_lines(p);
+
+  char *cur = NULL;
+  llong_t len = 0, cap = 0;
+  while (line < end) {
+    ssize_t n = pread(p->fd, p->buf, PAGER_CHUNK, off);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break;
+    off += n;
+
+    char *at = p->buf, *stop = p->buf + n;
+    while (at < stop && line < end) {
+      char *nl = memchr(at, '\n', stop - at);
+      llong_t seg = (nl ? nl : stop) - at;
+
+      // collect the bytes of wanted lines, up to PAGER_MAX_LINE of each
+      if (line >= s && len < PAGER_MAX_LINE) {
+        if (seg > PAGER_MAX_LINE - len)
+          seg = PAGER_MAX_LINE - len;
+        if (len + seg + 1 > cap) {
+          llong_t ncap = cap ? cap : 128;
+          while (len + seg + 1 > ncap)
+            ncap *= 2;
+          char *grown = realloc(cur, ncap);
+          if (!grown) {
+            free(cur);
+            return -1;
+          }
+          cur = grown;
+          cap = ncap;
+        }
+        memcpy(&cur[len], at, seg);
+        len += seg;
+      }
+      if (!nl)
+        break;
+
+      if (line >= s) {
+        pager_emit(p, cur ? cur : calloc(1, 1), len);
+        cur = NULL;
+        len = cap = 0;
+      }
+      line++;
+      at = nl + 1;
+    }
+  }
+
+  // the last line of the file may lack a newline
+  if (line >= s && line < end)
+    pager_emit(p, cur ? cur : calloc(1, 1), len);
+  else
+    free(cur);
+  return 0;
+}
+
+// return row y decoded from the file, or NULL if the file has no such line
+// the row stays valid until a row outside the current window is requested
+textrow *pager_row(pager *p, llong_t y) {
+  if (y >= p->first && y < p->first + p->nrows)
+    return &p->rows[y - p->first];
+  if (y < 0 || pager_scan(p, y + 1) <= y)
+    return NULL;
+
+  // keep some rows before y so that scrolling back stays in the window
+  llong_t s = y - PAGER_WINDOW / 4;
+  if (pager_fill(p, s < 0 ? 0 : s) == -1)
+    return NULL;
+  if (y >= p->first + p->nrows)
+    return NULL;
+  return &p->rows[y - p->first];
+}
+
+// count the newlines in len bytes at s
+static llong_t count_lines(const char *s, llong_t len) {
+  llong_t n = 0;
+  const char *end = s + len, *nl;
+  while ((nl = memchr(s, '\n', end - s))) {
+    n++;
+    s = nl + 1;
+  }
+  return n;
+}
+
+// return the first (or if last is set, the last) line in [from, to) whose
+// raw bytes contain needle, as matched by search_mem with flags, or -1 if
+// none does
+// reads the file a chunk at a time without decoding rows, advancing the
+// newline scan alongside so that the line found can be fetched
+llong_t pager_search(pager *p, llong_t from, llong_t to, const char *needle,
+                     llong_t nlen, int flags, int last) {
+  if (from >= to || pager_scan(p, from + 1) <= from)
+    return -1;
+  if (!p->sbuf && !(p->sbuf = malloc(PAGER_CHUNK)))
+    return -1;
+
+  llong_t k = from / PAGER_STRIDE;
+  llong_t line = k * PAGER_STRIDE, off = p->marks[k], found = -1;
+
+  // read no further than the indexed line at or after to, if there is one
+  llong_t stop = LLONG_MAX;
+  if (to < LLONG_MAX - PAGER_STRIDE &&
+      (to + PAGER_STRIDE - 1) / PAGER_STRIDE < p->nmarks)
+    stop = p->marks[(to + PAGER_STRIDE - 1) / PAGER_STRIDE];
+
+  while (line < to && off < stop) {
+    llong_t want = stop - off < PAGER_CHUNK ? stop - off : PAGER_CHUNK;
+    ssize_t n = pread(p->fd, p->sbuf, want, off);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0) {
+      pager_scan(p, LLONG_MAX); // note the end was reached
+      break;
+    }
+    while (!p->done && p->scanned < off + n)
+      pager_scan(p, pager_lines(p) + 1);
+
+    // search whole lines only, so matches never straddle two chunks, unless
+    // this is the end of the file or a line fills the chunk
+    char *lastnl = memrchr(p->sbuf, '\n', n);
+    llong_t len = (lastnl && n == PAGER_CHUNK) ? lastnl - p->sbuf + 1 : n;
+
+    char *at = p->sbuf, *end = p->sbuf + len, *nl;
+    while (line < from && (nl = memchr(at, '\n', end - at))) {
+      line++;
+      at = nl + 1;
+    }
+    while (line >= from && line < to) {
+      ullong_t mlen;
+      const char *m = search_mem(at, end - at, needle, nlen, flags, &mlen);
+      line += count_lines(at, (m ? m : end) - at);
+      if (!m || line >= to)
+        break;
+      if (!last)
+        return line;
+      found = line;
+
+      // carry on after the line holding the match
+      if (!(nl = memchr(m, '\n', end - m)))
+        break;
+      line++;
+      at = nl + 1;
+    }
+
+    // re-read the end of a line too long for the chunk in case a match
+    // straddles the boundary
+    llong_t overlap = (!lastnl && n == PAGER_CHUNK) ? 4 * nlen : 0;
+    off += (overlap < len) ? len - overlap : len;
+  }
+  return found;
+}
+
+void pager_close(pager *p) {
+  pager_drop(p);
+  free(p->rows);
+  free(p->marks);
+  free(p->buf);
+  free(p->sbuf);
+  if (p->fd != -1)
+    close(p->fd);
+  pager_init(p);
+}
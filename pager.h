@@ -0,0 +1,42 @@
+#ifndef PAGER_H
+#define PAGER_H
+
+#include "row.h"
+
+/* read-only paging through files too large to load */
+
+#define PAGER_STRIDE 1024        // lines between offsets kept in the index
+#define PAGER_WINDOW 1024        // rows decoded at a time
+#define PAGER_CHUNK (1 << 20)    // bytes read from the file at a time
+#define PAGER_MAX_LINE (1 << 20) // longer lines are cut short
+
+typedef struct pager {
+  int fd;          // file being paged, or -1
+  char *buf;       // PAGER_CHUNK bytes to read the file into
+  char *sbuf;      // PAGER_CHUNK bytes to search the file in, made on demand
+  llong_t *marks;  // offset of every PAGER_STRIDE-th line
+  llong_t nmarks;  // number of offsets in marks
+  llong_t markcap; // capacity of marks
+  llong_t nlines;  // newline-terminated lines found so far
+  llong_t scanned; // bytes scanned for newlines so far
+  llong_t linepos; // offset of the line after the last newline found
+  int done;        // set once the scan reached the end of the file
+  textrow *rows;   // window of decoded rows
+  llong_t first;   // line number of rows[0]
+  llong_t nrows;   // number of decoded rows
+} pager;
+
+void pager_init(pager *p);
+
+int pager_open(pager *p, const char *fname);
+
+llong_t pager_scan(pager *p, llong_t want);
+
+textrow *pager_row(pager *p, llong_t y);
+
+llong_t pager_search(pager *p, llong_t from, llong_t to, const char *needle,
+                     llong_t nlen, int flags, int last);
+
+void pager_close(pager *p);
+
+#endif
@@ -0,0 +1,50 @@
+#include "row.h"
+#include <stdlib.h>
+#include <string.h>
+
+// point row at the len chars of chars, a nul-terminated buffer from malloc,
+// moving them into the row itself and freeing chars if they fit
+// what the row held before is left to the caller, and render to be built
+void row_adopt(textrow *row, char *chars, llong_t len) {
+  row->len = len;
+  row->rlen = 0;
+  if (row_fits(len, -1)) {
+    memcpy(row->data.local, chars, len + 1);
+    free(chars);
+    row->flags = ROW_LOCAL | ROW_UNRENDERED;
+  } else {
+    row->data.ptr.chars = chars;
+    row->data.ptr.render = NULL;
+    row->flags = ROW_UNRENDERED;
+  }
+}
+
+// store len chars of s in row, in the row itself if they fit or else in a
+// buffer of their own, leaving render to be built
+// return 0, or -1 if out of memory
+int row_set(textrow *row, const char *s, llong_t len) {
+  char *chars = row->data.local;
+  row->flags = ROW_LOCAL | ROW_UNRENDERED;
+  if (!row_fits(len, -1)) {
+    if (!(chars = malloc(len + 1)))
+      return -1;
+    row->data.ptr.chars = chars;
+    row->data.ptr.render = NULL;
+    row->flags = ROW_UNRENDERED;
+  }
+  memcpy(chars, s, len);
+  chars[len] = '\0';
+  row->len = len;
+  row->rlen = 0;
+  return 0;
+}
+
+// free the chars, render and match cache of a row that owns all of them
+void row_free(textrow *row) {
+  if (!(row->flags & ROW_LOCAL)) {
+    free(row->data.ptr.chars);
+    if (!(row->flags & (ROW_ALIAS | ROW_UNRENDERED)))
+      free(row->data.ptr.render);
+  }
+  free(row->hl);
+}
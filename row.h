@@ -0,0 +1,77 @@
+#ifndef ROW_H
+#define ROW_H
+
+/* text rows */
+
+typedef long long llong_t;
+typedef unsigned long long ullong_t;
+
+#define ROW_LOCAL_SIZE 16 // bytes of chars a row can hold itself
+
+// longest row, short enough that even a row of tabs renders within 32 bits
+#define ROW_MAX_LEN ((1 << 30) - 1)
+
+// row flags
+#define ROW_LOCAL 1      // chars (and render) are held in the row itself
+#define ROW_ALIAS 2      // render is the same as chars, so not stored apart
+#define ROW_UNRENDERED 4 // render has not been built yet
+#define ROW_COLD 8       // chars are packed in a cold block, render not kept
+#define ROW_INTERNED 16  // chars and render are shared with an identical row
+#define ROW_ARENA 32     // chars and render are carved from the editor's arena
+
+// search matches cached for a row, kept apart since only drawn rows have any
+typedef struct rowmatches {
+  unsigned n;   // number of matches
+  unsigned cap; // capacity of at in (start, end) pairs
+  unsigned gen; // row generation the matches were found for
+  ullong_t qry; // query generation the matches were found for
+  llong_t at[]; // render (start, end) offsets of the matches
+} rowmatches;
+
+typedef struct textrow {
+  unsigned len;   // number of raw chars
+  unsigned rlen;  // number of rendered chars (e.g. tabs show as spaces)
+  union {
+    struct {
+      char *chars;  // raw chars
+      char *render; // rendered chars
+    } ptr;
+    char local[ROW_LOCAL_SIZE]; // raw chars, then rendered chars unless alias
+    struct {
+      struct coldblock *block;  // block holding the chars
+      unsigned off;             // offset of the chars in the unpacked block
+    } cold;
+  } data;
+  unsigned flags;  // ROW_* flags above
+  unsigned gen;    // edit generation, bumped whenever render is rebuilt
+  rowmatches *hl;  // cached search matches, or NULL
+  llong_t orig;    // offset of chars in the file on disk, -1 once edited
+} textrow;
+
+// return the raw chars of row, which must not be cold
+static inline char *row_chars(textrow *row) {
+  return (row->flags & ROW_LOCAL) ? row->data.local : row->data.ptr.chars;
+}
+
+// return the rendered chars of row, which must not be cold
+static inline char *row_render(textrow *row) {
+  if (row->flags & ROW_ALIAS)
+    return row_chars(row);
+  if (row->flags & ROW_LOCAL)
+    return &row->data.local[row->len + 1];
+  return row->data.ptr.render;
+}
+
+// return nonzero if a row of len chars rendering to rlen chars fits in the
+// row itself, where rlen is -1 if render is the same as chars
+static inline int row_fits(llong_t len, llong_t rlen) {
+  return len + 1 + (rlen < 0 ? 0 : rlen + 1) <= ROW_LOCAL_SIZE;
+}
+
+void row_adopt(textrow *row, char *chars, llong_t len);
+
+int row_set(textrow *row, const char *s, llong_t len);
+
+void row_free(textrow *row);
+
+#endif
@@ -0,0 +1,348 @@
+#define _GNU_SOURCE
+
+#include "save.h"
+#include "cold.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+// return path of a hidden file next to fname: .<name>.<ext>
+char *sidecar_path(const char *fname, const char *ext) {
+  const char *base = strrchr(fname, '/');
+  int dirlen = base ? base - fname + 1 : 0;
+  base = base ? base + 1 : fname;
+  char *path = malloc(strlen(fname) + strlen(ext) + 3);
+  if (path)
+    sprintf(path, "%.*s.%s.%s", dirlen, fname, base, ext);
+  return path;
+}
+
+static void stamp_stat(const struct stat *st, filestamp *stamp) {
+  stamp->dev = st->st_dev;
+  stamp->ino = st->st_ino;
+  stamp->size = st->st_size;
+  stamp->mtime_ns = st->st_mtim.tv_sec * 1000000000LL + st->st_mtim.tv_nsec;
+}
+
+// record the identity and version of fname in stamp
+// return 0, or -1 with errno set and stamp unset
+int stamp_file(const char *fname, filestamp *stamp) {
+  struct stat st;
+  if (stat(fname, &st) == -1) {
+    stamp->size = -1;
+    return -1;
+  }
+  stamp_stat(&st, stamp);
+  return 0;
+}
+
+// return whether a and b are set and stamp the same version of a file
+int stamp_equal(const filestamp *a, const filestamp *b) {
+  return a->size != -1 && a->dev == b->dev && a->ino == b->ino &&
+         a->size == b->size && a->mtime_ns == b->mtime_ns;
+}
+
+#ifndef IOV_MAX
+#define IOV_MAX 1024
+#endif
+
+// write every byte of iovcnt buffers in iov, which may be modified
+static int writev_all(int fd, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t n = writev(fd, iov, iovcnt);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1)
+      return -1;
+
+    // skip buffers that were written in full, then trim a partial one
+    while (iovcnt > 0 && (size_t)n >= iov->iov_len) {
+      n -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + n;
+      iov->iov_len -= n;
+    }
+  }
+  return 0;
+}
+
+// runs of unedited rows at least this long are copied from the source file
+// rather than written from memory
+#define SAVE_COPY_MIN (64 * 1024)
+
+// append len bytes at offset off of in to out, in the kernel where possible
+static int copy_range(int in, llong_t off, int out, llong_t len) {
+#ifdef __linux__
+  while (len > 0) {
+    loff_t from = off;
+    ssize_t n = copy_file_range(in, &from, out, NULL, len, 0);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      break; // e.g. unsupported across these filesystems, copy by hand
+    off += n;
+    len -= n;
+  }
+#endif
+
+  char buf[65536];
+  while (len > 0) {
+    size_t want = len < (llong_t)sizeof(buf) ? (size_t)len : sizeof(buf);
+    ssize_t n = pread(in, buf, want, off);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1)
+      return -1;
+    if (n == 0) {
+      errno = EIO; // source shrank since it was stamped
+      return -1;
+    }
+    struct iovec iov = {buf, n};
+    if (writev_all(out, &iov, 1) == -1)
+      return -1;
+    off += n;
+    len -= n;
+  }
+  return 0;
+}
+
+// return the number of bytes spanned in the source file by rows[i] and the
+// unedited rows directly following it there, and set *last to the last one
+static llong_t unedited_run(textrow *rows, llong_t nrows, llong_t i,
+                            llong_t *last) {
+  llong_t start = rows[i].orig;
+  llong_t end = start + rows[i].len;
+  while (i + 1 < nrows && rows[i + 1].orig == end + 1) {
+    i++;
+    end = rows[i].orig + rows[i].len;
+  }
+  *last = i;
+  return end - start;
+}
+
+// write rows to fd separated by newlines, gathering up to IOV_MAX buffers
+// into each writev call
+// long runs of unedited rows are copied from src instead, unless it is -1
+// cold rows are unpacked into cold a block at a time
+static int write_rows(int fd, textrow *rows, llong_t nrows, int src,
+                      coldbuf *cold, llong_t *written) {
+  static char newline[] = "\n";
+  struct iovec iov[IOV_MAX];
+  int iovcnt = 0;
+  llong_t plain = -1; // rows up to here are known to be written from memory
+
+  *written = 0;
+  for (llong_t i = 0; i < nrows; i++) {
+    if (iovcnt + 2 > IOV_MAX) {
+      if (writev_all(fd, iov, iovcnt) == -1)
+        return -1;
+      iovcnt = 0;
+    }
+
+    int copied = 0;
+    if (src != -1 && i > plain && rows[i].orig >= 0) {
+      llong_t last, bytes = unedited_run(rows, nrows, i, &last);
+      if (bytes >= SAVE_COPY_MIN) {
+        if (writev_all(fd, iov, iovcnt) == -1 ||
+            copy_range(src, rows[i].orig, fd, bytes) == -1)
+          return -1;
+        iovcnt = 0;
+        *written += bytes;
+        i = last;
+        copied = 1;
+      } else {
+        plain = last;
+      }
+    }
+
+    char *chars = (rows[i].flags & ROW_COLD) ? NULL : row_chars(&rows[i]);
+    if (!copied && rows[i].len && (rows[i].flags & ROW_COLD)) {
+      // unpacking another block overwrites rows gathered from the last one
+      if (cold->id != rows[i].data.cold.block->id) {
+        if (writev_all(fd, iov, iovcnt) == -1)
+          return -1;
+        iovcnt = 0;
+      }
+      if (!(chars = (char *)cold_read(&rows[i], cold)))
+        return -1;
+    }
+    if (!copied && rows[i].len) {
+      iov[iovcnt].iov_base = chars;
+      iov[iovcnt++].iov_len = rows[i].len;
+      *written += rows[i].len;
+    }
+    if (i < nrows - 1) {
+      iov[iovcnt].iov_base = newline;
+      iov[iovcnt++].iov_len = 1;
+      *written += 1;
+    }
+  }
+  return writev_all(fd, iov, iovcnt);
+}
+
+// fsync the directory holding path, so an entry renamed into it persists
+static int sync_dir(const char *path) {
+  char dir[PATH_MAX + 1];
+  const char *slash = strrchr(path, '/');
+  if (!slash)
+    strcpy(dir, ".");
+  else if (slash == path)
+    strcpy(dir, "/");
+  else {
+    memcpy(dir, path, slash - path);
+    dir[slash - path] = '\0';
+  }
+
+  int fd = open(dir, O_RDONLY | O_DIRECTORY);
+  if (fd == -1)
+    return -1;
+  int ret = fsync(fd);
+  int saved = errno;
+  close(fd);
+  errno = saved;
+  return ret;
+}
+
+// resolve the file a save to fname should replace into real
+static int save_target(const char *fname, int islink, char *real) {
+  if (!islink) {
+    if (strlen(fname) > PATH_MAX) {
+      errno = ENAMETOOLONG;
+      return -1;
+    }
+    strcpy(real, fname);
+    return 0;
+  }
+
+  char link[PATH_MAX + 1];
+  llong_t len = readlink(fname, link, PATH_MAX);
+  if (len == -1)
+    return -1;
+  link[len] = '\0';
+
+  // relative links are relative to the directory holding the link
+  const char *slash = strrchr(fname, '/');
+  int dirlen = (slash && link[0] != '/') ? slash - fname + 1 : 0;
+  if (dirlen + len > PATH_MAX) {
+    errno = ENAMETOOLONG;
+    return -1;
+  }
+  memcpy(real, fname, dirlen);
+  strcpy(&real[dirlen], link);
+  return 0;
+}
+
+// write rows to fname by writing a temp file and renaming it over fname (or
+// the file fname links to), keeping the mode and owner of the file replaced
+// rows whose orig is set hold the bytes at that offset of src, which are
+// copied from there while src still matches stamp (src may be NULL)
+// sync is one of enum save_sync
+// return 0 and the number of bytes written, 1 and the same if the file was
+// saved but its directory could not be synced after (errno and err are set,
+// as some network and FUSE filesystems refuse to), or -1 with errno set and
+// err naming the step that failed
+// only reads rows, so is safe to call from worker threads
+int save_rows(const char *fname, textrow *rows, llong_t nrows,
+              const char *src, const filestamp *stamp, int sync,
+              llong_t *written, const char **err) {
+  struct stat st;
+  mode_t fmode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH; // 0644
+  uid_t uid = getuid();
+  gid_t gid = getgid();
+  int islink = 0;
+
+  if (lstat(fname, &st) == 0) {
+    islink = S_ISLNK(st.st_mode);
+    if (!islink || stat(fname, &st) == 0) {
+      fmode = st.st_mode;
+      uid = st.st_uid;
+      gid = st.st_gid;
+    }
+  }
+
+  // expand target path if symlink
+  char real[PATH_MAX + 1];
+  if (save_target(fname, islink, real) == -1) {
+    *err = "readlink error";
+    return -1;
+  }
+
+  // create tmp file next to the target to write everything to
+  char tmpname[PATH_MAX + 8];
+  snprintf(tmpname, sizeof(tmpname), "%s.XXXXXX", real);
+  int fd = mkstemp(tmpname);
+  if (fd == -1) {
+    *err = "write error";
+    return -1;
+  }
+
+  // write lines to tmp file, reusing what is unchanged in the source
+  int in = src ? open(src, O_RDONLY) : -1;
+  filestamp now;
+  if (in != -1 && fstat(in, &st) == 0)
+    stamp_stat(&st, &now);
+  else
+    now.size = -1;
+  if (in != -1 && (!stamp || !stamp_equal(&now, stamp))) {
+    close(in);
+    in = -1;
+  }
+  coldbuf cold;
+  coldbuf_init(&cold);
+  int failed = write_rows(fd, rows, nrows, in, &cold, written) == -1;
+  int write_errno = errno;
+  coldbuf_free(&cold);
+  if (in != -1)
+    close(in);
+  errno = write_errno;
+  if (failed)
+    goto write_error;
+
+  // set file permissions before the file appears under its real name
+  if (fchmod(fd, fmode) == -1 || (fchown(fd, uid, gid) == -1 && errno != EPERM))
+    goto write_error;
+
+  // make sure the data is on disk before the new name can point at it
+  if (sync >= SAVE_SYNC_DATA && fdatasync(fd) == -1) {
+    int saved = errno;
+    unlink(tmpname);
+    close(fd);
+    errno = saved;
+    *err = "sync error";
+    return -1;
+  }
+
+  // rename tmp to target
+  if (rename(tmpname, real) == -1) {
+    int saved = errno;
+    unlink(tmpname);
+    close(fd);
+    errno = saved;
+    *err = "save error";
+    return -1;
+  }
+
+  close(fd);
+  if (sync >= SAVE_SYNC_DIR && sync_dir(real) == -1) {
+    *err = "directory sync error";
+    return 1; // the file is in place all the same
+  }
+  return 0;
+
+write_error:;
+  int saved = errno;
+  unlink(tmpname);
+  close(fd);
+  errno = saved;
+  *err = "write error";
+  return -1;
+}
@@ -0,0 +1,31 @@
+#ifndef SAVE_H
+#define SAVE_H
+
+#include "row.h"
+
+/* saving rows to disk */
+
+// identity and version of a file on disk, to tell whether it has changed
+typedef struct filestamp {
+  ullong_t dev, ino; // file identity
+  llong_t size;      // size in bytes, -1 if the stamp is unset
+  llong_t mtime_ns;  // modification time in nanoseconds
+} filestamp;
+
+// how hard save_rows works to make a save survive a crash or power loss
+enum save_sync {
+  SAVE_SYNC_NONE, // leave flushing to the kernel
+  SAVE_SYNC_DATA, // fdatasync the file before renaming it into place
+  SAVE_SYNC_DIR,  // and fsync its directory after, so the rename persists
+};
+
+char *sidecar_path(const char *fname, const char *ext);
+
+int stamp_file(const char *fname, filestamp *stamp);
+int stamp_equal(const filestamp *a, const filestamp *b);
+
+int save_rows(const char *fname, textrow *rows, llong_t nrows,
+              const char *src, const filestamp *stamp, int sync,
+              llong_t *written, const char **err);
+
+#endif
@@ -0,0 +1,164 @@
+#define _GNU_SOURCE
+
+#include "search.h"
+#include <string.h>
+#include <wctype.h>
+
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+typedef unsigned long long ullong_t;
+
+#define ASCII_FOLD(c) ((unsigned char)((c) - 'A') < 26 ? (c) | 0x20 : (c))
+#define WORD_BYTE(c) ((c) == '_' || (unsigned char)(c) >= 0x80 || isalnum_(c))
+
+static int isalnum_(unsigned char c) {
+  return (c >= '0' && c <= '9') || (unsigned char)((c | 0x20) - 'a') < 26;
+}
+
+// compare n bytes of a and b ignoring ascii case, return 0 if equal
+static int ascii_casecmp(const char *a, const char *b, ullong_t n) {
+  for (ullong_t i = 0; i < n; i++) {
+    unsigned char ca = a[i], cb = b[i];
+    if (ASCII_FOLD(ca) != ASCII_FOLD(cb))
+      return 1;
+  }
+  return 0;
+}
+
+#ifdef __SSE2__
+// fold ascii uppercase letters in v to lowercase
+static __m128i ascii_fold16(__m128i v) {
+  __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)),
+                                _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+  return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+#endif
+
+// find needle in hay ignoring ascii case
+// candidates are filtered on the needle's first and last byte, 16 at a time
+static const char *ascii_casemem(const char *hay, ullong_t hlen,
+                                 const char *needle, ullong_t nlen) {
+  if (nlen > hlen)
+    return NULL;
+  unsigned char first = needle[0], last = needle[nlen - 1];
+  first = ASCII_FOLD(first);
+  last = ASCII_FOLD(last);
+  ullong_t i = 0, limit = hlen - nlen; // last possible match start
+
+#ifdef __SSE2__
+  __m128i vfirst = _mm_set1_epi8(first), vlast = _mm_set1_epi8(last);
+  for (; i + 15 <= limit; i += 16) {
+    __m128i a = ascii_fold16(_mm_loadu_si128((const __m128i *)&hay[i]));
+    __m128i b =
+        ascii_fold16(_mm_loadu_si128((const __m128i *)&hay[i + nlen - 1]));
+    unsigned int mask = _mm_movemask_epi8(
+        _mm_and_si128(_mm_cmpeq_epi8(a, vfirst), _mm_cmpeq_epi8(b, vlast)));
+    while (mask) {
+      ullong_t at = i + __builtin_ctz(mask);
+      if (!ascii_casecmp(&hay[at], needle, nlen))
+        return &hay[at];
+      mask &= mask - 1;
+    }
+  }
+#endif
+
+  for (; i <= limit; i++) {
+    unsigned char c = hay[i];
+    if (ASCII_FOLD(c) == first && !ascii_casecmp(&hay[i], needle, nlen))
+      return &hay[i];
+  }
+  return NULL;
+}
+
+// decode the utf8 char at s into *cp, return its length in bytes
+// invalid sequences decode as a single byte
+static ullong_t utf8_decode(const unsigned char *s, ullong_t n,
+                            unsigned int *cp) {
+  ullong_t len = 1;
+  if (s[0] >= 0xF0)
+    len = 4;
+  else if (s[0] >= 0xE0)
+    len = 3;
+  else if (s[0] >= 0xC0)
+    len = 2;
+  if (len > n)
+    len = 1;
+
+  *cp = (len == 1) ? s[0] : s[0] & (0x7F >> len);
+  for (ullong_t i = 1; i < len; i++) {
+    if ((s[i] & 0xC0) != 0x80) {
+      *cp = s[0];
+      return 1;
+    }
+    *cp = (*cp << 6) | (s[i] & 0x3F);
+  }
+  return len;
+}
+
+// return length of hay text matching needle char by char ignoring case, or 0
+static ullong_t utf8_casematch(const char *hay, ullong_t hlen,
+                               const char *needle, ullong_t nlen) {
+  ullong_t i = 0, j = 0;
+  while (j < nlen) {
+    if (i >= hlen)
+      return 0;
+    unsigned int a, b;
+    i += utf8_decode((const unsigned char *)&hay[i], hlen - i, &a);
+    j += utf8_decode((const unsigned char *)&needle[j], nlen - j, &b);
+    if (a != b && towlower(a) != towlower(b))
+      return 0;
+  }
+  return i;
+}
+
+// find needle in hay ignoring case of any unicode char
+static const char *utf8_casemem(const char *hay, ullong_t hlen,
+                                const char *needle, ullong_t nlen,
+                                ullong_t *mlen) {
+  for (ullong_t i = 0; i < hlen; i++) {
+    if (((unsigned char)hay[i] & 0xC0) == 0x80)
+      continue; // only start matches at char boundaries
+    if ((*mlen = utf8_casematch(&hay[i], hlen - i, needle, nlen)))
+      return &hay[i];
+  }
+  return NULL;
+}
+
+// find the first match of needle in hay, storing the length of the matched
+// text in *mlen (which can differ from nlen when ignoring unicode case)
+const char *search_mem(const char *hay, ullong_t hlen, const char *needle,
+                       ullong_t nlen, int flags, ullong_t *mlen) {
+  if (!nlen)
+    return NULL;
+
+  int unicode = 0;
+  if (flags & SEARCH_ICASE) {
+    for (ullong_t i = 0; i < nlen && !unicode; i++)
+      unicode = (unsigned char)needle[i] >= 0x80;
+  }
+
+  ullong_t off = 0;
+  while (off < hlen) {
+    const char *match;
+    *mlen = nlen;
+    if (!(flags & SEARCH_ICASE))
+      match = memmem(&hay[off], hlen - off, needle, nlen);
+    else if (!unicode)
+      match = ascii_casemem(&hay[off], hlen - off, needle, nlen);
+    else
+      match = utf8_casemem(&hay[off], hlen - off, needle, nlen, mlen);
+
+    if (!match || !(flags & SEARCH_WORD))
+      return match;
+
+    // reject matches that are part of a larger word
+    ullong_t at = match - hay, end = at + *mlen;
+    if ((at == 0 || !WORD_BYTE(hay[at - 1])) &&
+        (end == hlen || !WORD_BYTE(hay[end])))
+      return match;
+    off = at + 1;
+  }
+  return NULL;
+}
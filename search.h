@@ -0,0 +1,13 @@
+#ifndef SEARCH_H
+#define SEARCH_H
+
+/* text search */
+
+#define SEARCH_ICASE 0x1 // ignore case
+#define SEARCH_WORD 0x2  // only match whole words
+
+const char *search_mem(const char *hay, unsigned long long hlen,
+                       const char *needle, unsigned long long nlen, int flags,
+                       unsigned long long *mlen);
+
+#endif
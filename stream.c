@@ -0,0 +1,92 @@
+#include "stream.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+
+void stream_init(stream *s) {
+  s->fd = -1;
+  s->wake[0] = s->wake[1] = -1;
+  ab_init(&s->pending);
+  s->eof = s->err = 0;
+}
+
+// read the pipe until it ends, handing data over through pending
+static void *stream_reader(void *arg) {
+  stream *s = arg;
+  char buf[65536];
+  while (1) {
+    ssize_t n = read(s->fd, buf, sizeof(buf));
+    if (n == -1 && errno == EINTR)
+      continue;
+
+    pthread_mutex_lock(&s->lock);
+    while (n > 0 && s->pending.len >= STREAM_MAX_PENDING && !s->eof)
+      pthread_cond_wait(&s->taken, &s->lock);
+    int wake = s->pending.len == 0; // the editor has seen everything so far
+    if (n > 0 && ab_strcat(&s->pending, buf, n) == -1)
+      n = -1;
+    if (n <= 0) {
+      s->eof = 1;
+      s->err = n == -1 ? errno : 0;
+      wake = 1;
+    }
+    int stop = s->eof;
+    pthread_mutex_unlock(&s->lock);
+
+    if (wake)
+      write(s->wake[1], "", 1);
+    if (stop)
+      return NULL;
+  }
+}
+
+// start reading fd in the background, taking ownership of it
+// return 0, or -1 with errno set
+int stream_open(stream *s, int fd) {
+  stream_init(s);
+  if (pipe(s->wake) == -1)
+    return -1;
+  fcntl(s->wake[0], F_SETFL, O_NONBLOCK);
+  s->fd = fd;
+  pthread_mutex_init(&s->lock, NULL);
+  pthread_cond_init(&s->taken, NULL);
+  if (pthread_create(&s->thread, NULL, stream_reader, s) != 0) {
+    close(s->wake[0]);
+    close(s->wake[1]);
+    stream_init(s);
+    errno = EAGAIN;
+    return -1;
+  }
+  return 0;
+}
+
+// move the data read so far into out, which must be freed with ab_free
+// return 1 if the pipe has ended and all its data was taken, otherwise 0
+int stream_take(stream *s, abuf *out) {
+  char drain[64];
+  while (read(s->wake[0], drain, sizeof(drain)) > 0)
+    ;
+
+  pthread_mutex_lock(&s->lock);
+  *out = s->pending;
+  ab_init(&s->pending);
+  int eof = s->eof;
+  pthread_cond_signal(&s->taken);
+  pthread_mutex_unlock(&s->lock);
+  return eof;
+}
+
+// stop reading, which waits for the reader if the pipe has not ended
+void stream_close(stream *s) {
+  if (s->fd == -1)
+    return;
+  pthread_join(s->thread, NULL);
+  close(s->fd);
+  close(s->wake[0]);
+  close(s->wake[1]);
+  ab_free(&s->pending);
+  pthread_mutex_destroy(&s->lock);
+  pthread_cond_destroy(&s->taken);
+  stream_init(s);
+}
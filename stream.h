@@ -0,0 +1,30 @@
+#ifndef STREAM_H
+#define STREAM_H
+
+#include "abuf.h"
+#include <pthread.h>
+
+/* reading a pipe in the background */
+
+#define STREAM_MAX_PENDING (64 << 20) // reader pauses with this much unread
+
+typedef struct stream {
+  int fd;               // pipe being read, or -1
+  int wake[2];          // written to whenever data arrives or the pipe ends
+  pthread_t thread;     // background reader
+  pthread_mutex_t lock; // guards everything below
+  pthread_cond_t taken; // signalled when pending data is taken
+  abuf pending;         // bytes read but not yet taken
+  int eof;              // set once the pipe has ended
+  int err;              // errno if reading the pipe failed
+} stream;
+
+void stream_init(stream *s);
+
+int stream_open(stream *s, int fd);
+
+int stream_take(stream *s, abuf *out);
+
+void stream_close(stream *s);
+
+#endif
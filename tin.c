@@ -3,17 +3,33 @@
 #define _GNU_SOURCE
 
 #include "abuf.h"
+#include "arena.h"
+#include "cold.h"
+#include "intern.h"
+#include "journal.h"
+#include "pager.h"
+#include "row.h"
+#include "save.h"
+#include "search.h"
+#include "stream.h"
+#include "tin.h"
+#include "tin_internal.h"
+#include "trace.h"
+#include "trigram.h"
+#include "undo.h"
+#include "watch.h"
 #include <ctype.h>
 #include <errno.h>
+#include <fcntl.h>
 #include <limits.h>
+#include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
-#include <sys/ioctl.h>
 #include <sys/stat.h>
-#include <termios.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -23,6 +39,21 @@
 #define TIN_TAB_STOP 4
 #define TIN_STATUS_MSG_SECS 2
 #define TIN_QUIT_TIMES 2
+#define TIN_BLOCK_ROWS 256        // rows per search index block
+#define TIN_INDEX_MIN_ROWS 16384 // only index buffers at least this long
+#define TIN_REPLACE_MAX_THREADS 16
+#define TIN_REPLACE_THREAD_ROWS 65536 // min rows per replace-all thread
+#define TIN_FRAME_MS 16             // min time between redraws for appends
+#define TIN_FOLLOW_POLL_MS 100      // time between checks without inotify
+#define TIN_RESYNC_QUIET_MS 50      // time a file must go unchanged to resync
+#define TIN_FOLLOW_CHUNK (1 << 20)  // bytes read from a followed file at once
+#define TIN_FOLLOW_FRAME (64 << 20) // max bytes read from it per redraw
+#define TIN_COLD_FILE (256LL << 20) // files at least this big load compressed
+#define TIN_COLD_BLOCK (64 << 10)   // bytes of rows packed into a block
+#define TIN_WARM_ROWS 4096          // rows either side of the screen not packed
+#define TIN_COLD_SWEEP 65536        // rows checked for packing per idle tick
+#define TIN_COLD_TICK (1 << 20)     // max bytes packed per idle tick
+#define TIN_TIMED_FRAMES 256        // frames the timing overlay's p99 covers
 #define ESC_SEQ "\x1b["
 #define CTRL_KEY(key) (0x1f & (key))
 #define REPORT_ERR(msg) (set_status_msg(msg ": %s", strerror(errno)))
@@ -55,20 +86,70 @@ enum named_key {
   END_KEY,
   PAGE_UP,
   PAGE_DOWN,
+  REDRAW_KEY, // not typed, but returned when the screen changed under a prompt
 };
 
-typedef long long llong_t;
-typedef unsigned long long ullong_t;
-
-typedef struct textrow {
-  llong_t len;  // number of raw chars
-  char *chars;  // raw chars
-  llong_t rlen; // number of rendered chars (e.g. tabs show as spaces)
-  char *render; // rendered chars
-} textrow;
-
-struct config {
-  struct termios orig_tty;
+typedef struct memstats {
+  ullong_t rows;       // row arrays
+  ullong_t chars;      // chars in buffers of their own
+  ullong_t render;     // render in buffers of their own
+  ullong_t arena;      // arena slabs holding loaded chars and render
+  ullong_t arena_used; // bytes of the slabs handed out
+  ullong_t cold;       // compressed blocks of rows away from the screen
+  ullong_t ncold;      // rows held in cold blocks
+  ullong_t intern;     // table of loaded rows, to share identical ones
+  ullong_t interned;   // rows sharing chars with an identical row
+  ullong_t saved;      // bytes the interned rows would otherwise take
+  ullong_t local;      // rows holding their chars in themselves
+  ullong_t matches;    // cached search matches
+  ullong_t index;      // search index
+  ullong_t undo;       // undo history
+  ullong_t frame;      // buffer the last frame was drawn into
+  ullong_t pager;      // pager buffers and line offsets
+} memstats;
+
+typedef struct mempart {
+  const char *name; // short name for the status bar
+  ullong_t n;       // bytes held
+} mempart;
+
+// how long the last frame took, in microseconds, for the timing overlay
+typedef struct frametimes {
+  llong_t key;    // handling the key read before it
+  llong_t scroll; // paging in rows and scrolling to the cursor
+  llong_t rows;   // drawing the rows and status bars
+  llong_t write;  // writing the frame out
+  ullong_t bytes; // bytes written
+  llong_t recent[TIN_TIMED_FRAMES]; // key to written times of recent frames
+  llong_t nrecent;                  // frames timed in all
+} frametimes;
+
+typedef struct rowblock {
+  int built;    // set once tri covers every row in the block
+  trigrams tri; // trigrams of the rendered rows in the block
+} rowblock;
+
+typedef struct snapshot {
+  textrow *rows;         // rows being written, shared with E.rows until edited
+  llong_t nrows;         // number of rows being written
+  ullong_t gen;          // rows up to this generation share chars with rows
+  int active;            // set while a worker may be reading rows
+  int done;              // set by the worker once finished, guarded by lock
+  int err;               // errno of a failed write, guarded by lock
+  const char *what;      // step that failed, guarded by lock
+  char *path;            // file being written
+  char *src;             // file unedited rows can be copied from
+  filestamp stamp;       // version of src that row offsets refer to
+  int sync;              // durability of the write (enum save_sync)
+  pthread_t thread;      // worker writing rows
+  pthread_mutex_t lock;  // guards done, err and what
+  char **garbage;        // chars and blocks dropped by the editor while shared
+  llong_t ngarbage;      // number of dropped chars and blocks
+  llong_t garbagecap;    // capacity of garbage
+} snapshot;
+
+struct tin {
+  tin_io io;                // where keys are read and frames written
   llong_t cx, cy;           // cursor position
   llong_t rx;               // horizontal cursor render position
   llong_t winrows, wincols; // window size
@@ -76,18 +157,80 @@ struct config {
   llong_t lnoff;            // line number offset
   llong_t nrows;            // number of text rows
   textrow *rows;            // text lines
+  arena arena;              // chars and render of rows loaded from the file
+  int cold;                 // set to pack rows away from the screen in blocks
+  ullong_t cold_bytes;      // bytes of cold blocks still in use
+  llong_t cold_next;        // row the next sweep for rows to pack starts at
+  coldbuf peek;             // block last unpacked to read cold rows in place
+  char *peek_render;        // render of the last cold row read in place
+  llong_t peek_rcap;        // capacity of peek_render
+  int dedup;                // set to share chars of identical rows (--dedup)
+  interns interns;          // chars of rows loaded so far, when deduplicating
   char *filename;           // filename
+  filestamp stamp;          // version of filename that row offsets refer to
   char statusmsg[128];      // status message
   time_t statusmsg_time;    // time status message was last updated
   ullong_t dirty;           // number of changes since last save
+  ullong_t gen;             // last row generation handed out
+  char *query;              // current search query (highlighted)
+  llong_t qlen;             // length of current search query
+  int sflags;               // search mode flags (SEARCH_ICASE, SEARCH_WORD)
+  ullong_t qgen;            // bumped whenever the search query or mode changes
+  rowblock *blocks;         // search index over blocks of rows, built lazily
+  llong_t nblocks;          // number of allocated index blocks
+  llong_t blocks_valid;     // index blocks from here on must be rebuilt
+  undo_log undo;            // edits that can be undone and redone
+  journal journal;          // edits since the last save, for crash recovery
+  snapshot snap;            // rows being autosaved by a worker thread
+  pager pager;              // file paged read-only instead of loaded (-R)
+  int follow;               // set to append rows written to the file (-f)
+  stream stream;            // piped input being read in, for file "-"
+  watch watch;              // inotify watch on the file
+  llong_t tail;             // bytes of the file read into rows so far
+  int tail_open;            // set if the file's last line has no newline yet
+  ullong_t tail_dev;        // device of the file being followed
+  ullong_t tail_ino;        // inode of the file being followed
+  int file_due;             // set once the file changed and is to be read
+  llong_t changed_ms;       // time the file was last seen to change
+  llong_t drawn_ms;         // time of the last redraw
+  llong_t key_us;           // time the last key was read, 0 once drawn
+  int timing;               // set to show frame timings in the top bar
+  frametimes times;         // timings of the last frames drawn
+  tracer trace;             // events written to a trace file ($TIN_TRACE)
+  ullong_t frame_size;      // capacity of the buffer of the last frame
+  int sync;                 // durability of saves (enum save_sync)
+  int autosave_secs;        // seconds between autosaves, or 0 if disabled
+  time_t autosave_time;     // time the last autosave started
+  ullong_t autosave_dirty;  // dirty count when the last autosave started
+  int waiting;              // set while waiting for a key in the main loop
+  int quit;                 // set once the editor has quit
+  // set when the screen changed size, perhaps by a signal handler
+  volatile sig_atomic_t resized;
 };
 
-struct config E; // global editor config
+// the editor being driven, set by each tin_* call
+// each thread has its own, so workers are handed the editor in their jobs
+__thread tin *cur;
+#define E (*cur)
+
+// names of the save durability levels, indexed by enum save_sync
+const char *sync_names[] = {"none", "data", "dir"};
 
 /* prototypes */
 
 int read_key();
+int read_answer();
+void autosave_finish();
 void clear_tty();
+void refresh_screen();
+void remove_autosave();
+void print_mem(FILE *fp);
+void format_bytes(char *buf, ullong_t size, ullong_t n);
+int resync_file();
+llong_t row_matches(textrow *row);
+void warm_row(textrow *row);
+const char *peek_chars(textrow *row);
+const char *peek_render(textrow *row);
 
 /* helpers */
 
@@ -107,6 +250,39 @@ void set_status_msg(const char *fmt, ...) {
   E.statusmsg_time = time(NULL);
 }
 
+// return milliseconds from a monotonic clock
+llong_t now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// return microseconds from a monotonic clock
+llong_t now_us() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+}
+
+// add an event named name to the trace, if tracing: a span from start until
+// now, or a mark now if start is -1, with args formatted as the members of a
+// json object (or NULL)
+void trace(const char *name, llong_t start, const char *fmt, ...) {
+  if (E.trace.fd == -1)
+    return;
+  char args[256] = "";
+  if (fmt) {
+    va_list ap;
+    va_start(ap, fmt);
+    vsnprintf(args, sizeof(args), fmt, ap);
+    va_end(ap);
+  }
+  if (start == -1)
+    trace_mark(&E.trace, name, now_us(), args);
+  else
+    trace_span(&E.trace, name, start, now_us(), args);
+}
+
 // return the number of characters needed to represent n
 int nplaces(llong_t n) {
   if (n < 0)
@@ -150,111 +326,157 @@ int nplaces(llong_t n) {
   return 19;
 }
 
-/* terminal config */
-
-// set rows, cols to current cursor position
-int cursor_pos(llong_t *rows, llong_t *cols) {
-  if (write(STDOUT_FILENO, ESC_SEQ "6n", 4) != 4)
-    return -1;
-
-  char buf[64] = "";
-  for (unsigned int i = 0; i < sizeof(buf) - 1; i++) {
-    if (read(STDIN_FILENO, &buf[i], 1) != 1)
-      break;
-    if (buf[i] == 'R')
-      break;
-  }
-
-  // response is of the form: <ESC_SEQ>row;colR
-  // see https://vt100.net/docs/vt100-ug/chapter3.html#CPR
-  if (buf[0] != ESC_SEQ[0] || buf[1] != ESC_SEQ[1])
-    return -1;
-  if (sscanf(&buf[2], "%lld;%lld", rows, cols) != 2)
-    return -1;
-
-  return 0;
+// return the FNV-1a hash of len bytes at s
+ullong_t hash_bytes(const char *s, llong_t len) {
+  ullong_t h = 14695981039346656037ULL;
+  for (llong_t i = 0; i < len; i++)
+    h = (h ^ (unsigned char)s[i]) * 1099511628211ULL;
+  return h;
 }
 
-// try to get window size using ioctl first
-// otherwise, move cursor to bottom right and get position
-int measure_window(llong_t *rows, llong_t *cols) {
-  struct winsize ws;
-  if (ioctl(STDOUT_FILENO, TIOCGWINSZ, &ws) == -1 || ws.ws_col == 0) {
-    // try to check window size by moving cursor to bottom right
-    if (write(STDOUT_FILENO, ESC_SEQ "999C" ESC_SEQ "999B", 12) != 12)
-      return -1;
-    return cursor_pos(rows, cols);
-  } else {
-    *rows = ws.ws_row;
-    *cols = ws.ws_col;
-  }
-  return 0;
-}
+/* screen size */
 
 void set_editor_size() {
-  if (measure_window(&E.winrows, &E.wincols) == -1)
-    die("measure_window");
+  if (E.io.size(E.io.ctx, &E.winrows, &E.wincols) == -1)
+    die("window size");
   E.winrows -= 2; // for status bar and status message
 }
 
-void init_config() {
+void init_config(const tin_io *io) {
+  E.io = *io;
   E.cx = E.cy = E.rx = 0;
   E.rowoff = E.coloff = 0;
   E.nrows = 0;
   E.rows = NULL;
+  arena_init(&E.arena);
+  E.cold = 0;
+  E.cold_bytes = 0;
+  E.cold_next = 0;
+  coldbuf_init(&E.peek);
+  E.peek_render = NULL;
+  E.peek_rcap = 0;
+  E.dedup = 0;
+  intern_init(&E.interns);
   E.lnoff = 2; // single digit line number to start, plus one space
   E.filename = NULL;
+  E.stamp.size = -1;
   E.statusmsg[0] = '\0';
   E.statusmsg_time = 0;
   E.dirty = 0;
+  E.gen = 0;
+  E.query = NULL;
+  E.qlen = 0;
+  E.sflags = 0;
+  E.qgen = 1;
+  E.blocks = NULL;
+  E.nblocks = E.blocks_valid = 0;
+  undo_init(&E.undo);
+  journal_init(&E.journal);
+  memset(&E.snap, 0, sizeof(E.snap));
+  pager_init(&E.pager);
+  E.follow = 0;
+  stream_init(&E.stream);
+  watch_init(&E.watch);
+  E.tail = E.tail_open = 0;
+  E.tail_dev = E.tail_ino = 0;
+  E.file_due = 0;
+  E.changed_ms = 0;
+  E.drawn_ms = 0;
+  E.key_us = 0;
+  E.timing = 0;
+  memset(&E.times, 0, sizeof(E.times));
+  trace_init(&E.trace);
+  E.frame_size = 0;
+  pthread_mutex_init(&E.snap.lock, NULL);
+  E.sync = SAVE_SYNC_DIR;
+  E.autosave_secs = 0;
+  E.autosave_time = 0;
+  E.autosave_dirty = 0;
+  E.waiting = 0;
+  E.quit = 0;
   set_editor_size();
 }
 
 /* tty control */
 
 void clear_tty() {
-  write(STDOUT_FILENO, ESC_SEQ "2J", 4); // clear screen
-  write(STDOUT_FILENO, ESC_SEQ "H", 3);  // move cursor to top left
+  E.io.write(E.io.ctx, ESC_SEQ "2J", 4); // clear screen
+  E.io.write(E.io.ctx, ESC_SEQ "H", 3);  // move cursor to top left
 }
 
-void disable_raw_tty() {
-  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &E.orig_tty) == -1)
-    die("tcsetattr");
-}
-
-void enable_raw_tty() {
-  if (tcgetattr(STDIN_FILENO, &E.orig_tty) == -1)
-    die("tcgetattr");
+/* pager */
 
-  atexit(disable_raw_tty);
-  struct termios tty = E.orig_tty;
+// return whether the file is being paged rather than loaded
+int paging() { return E.pager.fd != -1; }
 
-  // input flags
-  tty.c_iflag &= ~IXON;   // fix ^S, ^Q
-  tty.c_iflag &= ~ICRNL;  // fix ^M (CR)
-  tty.c_iflag &= ~BRKINT; // breaks still send SIGINT
-  tty.c_iflag &= ~INPCK;  // disable parity checking
-  tty.c_iflag &= ~ISTRIP; // disable stripping of 8th bit
+// when paging, count lines through row y so that E.nrows covers it
+void page_to(llong_t y) {
+  if (paging())
+    E.nrows = pager_scan(&E.pager, y + 1);
+}
 
-  // output flags
-  tty.c_oflag &= ~OPOST; // disable output processing
+// return row y, decoding it from the file when paging or thawing it if cold
+// a paged row stays valid only until another row is fetched
+textrow *get_row(llong_t y) {
+  if (!paging()) {
+    warm_row(&E.rows[y]);
+    return &E.rows[y];
+  }
+  textrow *row = pager_row(&E.pager, y);
+  if (!row)
+    die("pager");
+  if (row->flags & ROW_UNRENDERED)
+    render_row(row);
+  return row;
+}
 
-  // control flags and chars
-  tty.c_cflag |= CS8;  // 8-bit chars
-  tty.c_cc[VMIN] = 0;  // min bytes to read before returning
-  tty.c_cc[VTIME] = 1; // time to wait for min bytes (* 0.1s)
+// return whether key only reads the buffer, so can be used while paging
+int pager_key(int key) {
+  switch (key) {
+  case CTRL_KEY('x'):
+  case CTRL_KEY('f'):
+  case CTRL_KEY('g'):
+  case CTRL_KEY('k'):
+  case CTRL_KEY('l'):
+  case ARROW_UP:
+  case ARROW_DOWN:
+  case ARROW_LEFT:
+  case ARROW_RIGHT:
+  case HOME_KEY:
+  case END_KEY:
+  case PAGE_UP:
+  case PAGE_DOWN:
+  case ESC:
+    return 1;
+  default:
+    return 0;
+  }
+}
 
-  // local flags
-  tty.c_lflag &= ~ECHO;   // disable character echo
-  tty.c_lflag &= ~ICANON; // disable canonical mode (line buffering)
-  tty.c_lflag &= ~IEXTEN; // fix ^V, ^O
-  tty.c_lflag &= ~ISIG;   // fix ^C, ^Z
+/* status bar */
 
-  if (tcsetattr(STDIN_FILENO, TCSAFLUSH, &tty) == -1)
-    die("tcsetattr");
+int cmp_llong(const void *a, const void *b) {
+  llong_t x = *(const llong_t *)a, y = *(const llong_t *)b;
+  return (x > y) - (x < y);
 }
 
-/* status bar */
+// write the timings of the last frame into buf of size bytes, along with the
+// p99 from reading a key to writing the frame after it over recent frames
+// return the length written
+llong_t draw_timings(char *buf, llong_t size) {
+  frametimes *t = &E.times;
+  llong_t n = t->nrecent < TIN_TIMED_FRAMES ? t->nrecent : TIN_TIMED_FRAMES;
+  llong_t sorted[TIN_TIMED_FRAMES];
+  memcpy(sorted, t->recent, sizeof(llong_t) * n);
+  qsort(sorted, n, sizeof(llong_t), cmp_llong);
+  char bytes[16];
+  format_bytes(bytes, sizeof(bytes), t->bytes);
+  llong_t len = snprintf(
+      buf, size, "key %lld scroll %lld rows %lld write %lld us %s p99 %lld us",
+      t->key, t->scroll, t->rows, t->write, bytes,
+      n ? sorted[(n - 1) * 99 / 100] : 0);
+  return len < size ? len : (size ? size - 1 : 0);
+}
 
 void draw_top_status(abuf *ab) {
   ab_strcat(ab, ESC_SEQ "7m", 4); // reverse colors
@@ -262,18 +484,22 @@ void draw_top_status(abuf *ab) {
   // calculate components
   char *fname = E.filename ? E.filename : "[New]";
   char *dirty = E.dirty ? "*" : " ";
-  llong_t row = E.rows ? E.cy + 1 : 0;
+  llong_t row = (E.rows || E.nrows) ? E.cy + 1 : 0;
   llong_t col = E.rx + 1;
   llong_t nrows = E.nrows;
+  char *more = (paging() && !E.pager.done) ? "+" : ""; // not counted yet
 
   // build status bar
   llong_t barlen = E.wincols;
   char lmsg[barlen + 1], rmsg[barlen + 1];
   llong_t rlen = barlen;
-  rlen = snprintf(rmsg, rlen, "L%lld/%lld C%lld (%lldx%lld)", row, nrows, col,
-                  E.winrows, E.wincols);
+  rlen = snprintf(rmsg, rlen, "L%lld/%lld%s C%lld (%lldx%lld)", row, nrows,
+                  more, col, E.winrows, E.wincols);
   llong_t llen = barlen - rlen;
-  llen = snprintf(lmsg, llen, "[%s] %.20s", dirty, fname);
+  if (E.timing)
+    llen = draw_timings(lmsg, llen);
+  else
+    llen = snprintf(lmsg, llen, "[%s] %.20s", dirty, fname);
 
   // write status bar
   ab_strcat(ab, lmsg, llen);
@@ -308,9 +534,10 @@ void draw_bot_status(abuf *ab) {
 /* main interface */
 
 llong_t cx_to_rx(textrow *row, llong_t cx) {
+  const char *chars = row_chars(row);
   llong_t rx = 0;
   for (llong_t j = 0; j < cx; j++) {
-    char c = row->chars[j];
+    char c = chars[j];
     if (c == TAB_KEY)
       rx += TIN_TAB_STOP - (rx % TIN_TAB_STOP);
     else if (UTF_BODY_BYTE(c))
@@ -322,9 +549,10 @@ llong_t cx_to_rx(textrow *row, llong_t cx) {
 }
 
 llong_t rx_to_cx(textrow *row, int rx) {
+  const char *chars = row_chars(row);
   llong_t cx, cur_rx = 0;
   for (cx = 0; cx < row->len; cx++) {
-    char c = row->chars[cx];
+    char c = chars[cx];
     if (c == TAB_KEY)
       cur_rx += TIN_TAB_STOP - (cur_rx % TIN_TAB_STOP);
     else if (UTF_BODY_BYTE(c))
@@ -349,7 +577,8 @@ void draw_welcome(abuf *ab, int line) {
     len = snprintf(msg, sizeof(msg), "version %s", TIN_VERSION);
     break;
   case 2:
-    len = snprintf(msg, sizeof(msg), "^X exit    ^S save    ^F find");
+    len = snprintf(msg, sizeof(msg),
+                   "^X exit    ^S save    ^F find    ^R replace");
     break;
   default:
     len = 0;
@@ -371,7 +600,7 @@ void scroll() {
   // differs from cx if line contains tabs
   E.rx = 0;
   if (E.cy < E.nrows) {
-    E.rx = cx_to_rx(&E.rows[E.cy], E.cx);
+    E.rx = cx_to_rx(get_row(E.cy), E.cx);
   }
 
   // adjust offsets if cursor is off screen
@@ -404,7 +633,8 @@ void draw_rows(abuf *ab) {
       }
     } else {
       // get row to be drawn
-      textrow *row = &E.rows[filerow];
+      textrow *row = get_row(filerow);
+      const char *render = row_render(row);
 
       // draw line number
       char numstr[E.lnoff];
@@ -413,28 +643,48 @@ void draw_rows(abuf *ab) {
       while (numlen++ < E.lnoff - 1) {
         ab_charcat(ab, ' ');
       }
-      ab_strcat(ab, numstr, E.lnoff - 1);
+      ab_strcat(ab, numstr, strlen(numstr));
       ab_strcat(ab, ESC_SEQ "m", 3); // reset colors
       ab_charcat(ab, ' ');
 
-      llong_t displen, i;
-      displen = i = 0;
-      while (i < row->rlen && displen <= E.coloff) {
-        char c = row->render[i++];
-        if (VISIBLE_BYTE(c))
+      // skip coloff visible chars, then take as many as fit on screen
+      llong_t displen = 0, start = 0;
+      while (start < row->rlen && displen < E.coloff) {
+        if (VISIBLE_BYTE(render[start]))
           displen++;
+        start++;
       }
-      llong_t start = --i;
+      while (start < row->rlen && !VISIBLE_BYTE(render[start]))
+        start++;
+      llong_t end = start;
       displen = 0;
-      while (i < row->rlen && displen + E.lnoff < E.wincols) {
-        char c = row->render[i++];
-        if (VISIBLE_BYTE(c))
-          displen++;
+      while (end < row->rlen) {
+        if (VISIBLE_BYTE(render[end]) && displen++ + E.lnoff >= E.wincols)
+          break;
+        end++;
       }
-      llong_t end = i;
 
-      // draw row
-      ab_strcat(ab, &E.rows[filerow].render[start], end - start);
+      // draw row, highlighting search matches in the visible slice
+      llong_t pos = start;
+      llong_t nhl = row_matches(row);
+      for (llong_t m = 0; m < nhl && pos < end; m++) {
+        llong_t hl_start = row->hl->at[2 * m];
+        llong_t hl_end = row->hl->at[2 * m + 1];
+        if (hl_end <= pos)
+          continue;
+        if (hl_start < pos)
+          hl_start = pos;
+        if (hl_end > end)
+          hl_end = end;
+        if (hl_start >= hl_end)
+          break;
+        ab_strcat(ab, &render[pos], hl_start - pos);
+        ab_strcat(ab, ESC_SEQ "7m", 4); // reverse colors
+        ab_strcat(ab, &render[hl_start], hl_end - hl_start);
+        ab_strcat(ab, ESC_SEQ "m", 3); // reset colors
+        pos = hl_end;
+      }
+      ab_strcat(ab, &render[pos], end - pos);
     }
 
     ab_strcat(ab, ESC_SEQ "K", 3); // clear line being drawn
@@ -442,7 +692,34 @@ void draw_rows(abuf *ab) {
   }
 }
 
+// note how long each step of a frame took, from the times they started at
+// and the time the frame was written at
+void time_frame(llong_t start, llong_t rows, llong_t write, llong_t end,
+                ullong_t bytes) {
+  frametimes *t = &E.times;
+  t->key = E.key_us ? start - E.key_us : 0;
+  t->scroll = rows - start;
+  t->rows = write - rows;
+  t->write = end - write;
+  t->bytes = bytes;
+  if (E.key_us)
+    t->recent[t->nrecent++ % TIN_TIMED_FRAMES] = end - E.key_us;
+
+  if (E.trace.fd != -1) {
+    char args[64];
+    snprintf(args, sizeof(args), "\"bytes\":%llu,\"latency\":%lld", bytes,
+             E.key_us ? end - E.key_us : 0);
+    trace_span(&E.trace, "frame", start, end, args);
+    trace_span(&E.trace, "scroll", start, rows, NULL);
+    trace_span(&E.trace, "draw", rows, write, NULL);
+    trace_span(&E.trace, "write", write, end, NULL);
+  }
+  E.key_us = 0;
+}
+
 void refresh_screen() {
+  llong_t start = now_us();
+  page_to(E.rowoff + 2 * E.winrows); // a screen past the one drawn
   scroll();
   E.lnoff = nplaces(E.nrows) + 1; // calculate line number offset
 
@@ -451,6 +728,7 @@ void refresh_screen() {
   ab_strcat(&ab, ESC_SEQ "?25l", 6); // hide cursor
   ab_strcat(&ab, ESC_SEQ "H", 3);    // move cursor to top left
 
+  llong_t rows = now_us();
   draw_top_status(&ab);
   draw_rows(&ab);
   draw_bot_status(&ab);
@@ -463,96 +741,565 @@ void refresh_screen() {
   ab_strcat(&ab, buf, strlen(buf));
 
   ab_strcat(&ab, ESC_SEQ "?25h", 6);    // show cursor
-  write(STDOUT_FILENO, ab.buf, ab.len); // write buffer to stdout
+  llong_t write = now_us();
+  E.io.write(E.io.ctx, ab.buf, ab.len); // write buffer to the screen
+  time_frame(start, rows, write, now_us(), ab.len);
+  E.frame_size = ab.size;
   ab_free(&ab);
+  E.drawn_ms = now_ms();
+}
+
+/* search index */
+
+// mark index blocks from the one containing row at onwards as stale, since
+// inserting or deleting a row shifts every later row into a new block
+void index_shift(llong_t at) {
+  llong_t b = at / TIN_BLOCK_ROWS;
+  if (b < E.blocks_valid)
+    E.blocks_valid = b;
+}
+
+// add the trigrams of an updated row to its index block if already built
+// stale trigrams from the old row contents only cost false positives
+void index_update(textrow *row) {
+  llong_t b = (row - E.rows) / TIN_BLOCK_ROWS;
+  if (b < E.blocks_valid && E.blocks[b].built)
+    tri_add(&E.blocks[b].tri, row_render(row), row->rlen);
+}
+
+// return nonzero if block b may contain every trigram in q
+// the block is built on first use
+int index_may_match(llong_t b, trigrams *q) {
+  rowblock *blk = &E.blocks[b];
+  if (!blk->built) {
+    llong_t end = (b + 1) * TIN_BLOCK_ROWS;
+    if (end > E.nrows)
+      end = E.nrows;
+    tri_clear(&blk->tri);
+    for (llong_t i = b * TIN_BLOCK_ROWS; i < end; i++)
+      tri_add(&blk->tri, peek_render(&E.rows[i]), E.rows[i].rlen);
+    blk->built = 1;
+  }
+  return tri_contains(&blk->tri, q);
+}
+
+// fill q with the trigrams of the current query and size the index for
+// the buffer, returning 0 if the index is not worth using for this search
+int index_prepare(trigrams *q) {
+  if (E.nrows < TIN_INDEX_MIN_ROWS || E.qlen < 3 || paging())
+    return 0; // paged rows are not kept around to index
+  // blocks are hashed on ascii-folded bytes only
+  if (E.sflags & SEARCH_ICASE) {
+    for (llong_t i = 0; i < E.qlen; i++) {
+      if ((unsigned char)E.query[i] >= 0x80)
+        return 0;
+    }
+  }
+
+  llong_t nblocks = (E.nrows + TIN_BLOCK_ROWS - 1) / TIN_BLOCK_ROWS;
+  if (nblocks > E.nblocks) {
+    if (!(E.blocks = realloc(E.blocks, sizeof(rowblock) * nblocks)))
+      die("realloc");
+  }
+  for (llong_t b = E.blocks_valid; b < nblocks; b++)
+    E.blocks[b].built = 0;
+  E.nblocks = E.blocks_valid = nblocks;
+
+  tri_clear(q);
+  tri_add(q, E.query, E.qlen);
+  return 1;
+}
+
+/* snapshots */
+
+// return a new edit generation for a row
+// rows only keep 32 bits of it, so once those run out every row is
+// renumbered, which has to wait for a snapshot comparing against them
+unsigned next_gen() {
+  if (E.gen >= UINT_MAX) {
+    autosave_finish();
+    for (llong_t i = 0; i < E.nrows; i++) {
+      E.rows[i].gen = 0;
+      if (E.rows[i].hl)
+        E.rows[i].hl->qry = 0; // never a query generation, so rebuilt
+    }
+    E.gen = 0;
+  }
+  return ++E.gen;
+}
+
+// return nonzero if an autosave snapshot still refers to row's chars
+int row_shared(textrow *row) {
+  return E.snap.active && row->gen <= E.snap.gen;
+}
+
+// free chars, or hand them to the snapshot to free if it may still read them
+// chars in the arena must not be passed, as they are freed with it
+void release_chars(char *chars, int shared) {
+  if (!shared) {
+    free(chars);
+    return;
+  }
+  if (E.snap.ngarbage == E.snap.garbagecap) {
+    E.snap.garbagecap = E.snap.garbagecap ? E.snap.garbagecap * 2 : 64;
+    E.snap.garbage =
+        realloc(E.snap.garbage, sizeof(char *) * E.snap.garbagecap);
+    if (!E.snap.garbage)
+      die("realloc");
+  }
+  E.snap.garbage[E.snap.ngarbage++] = chars;
+}
+
+// note that a row no longer reads from blk, which is released once no row
+// does
+void release_block(coldblock *blk, int shared) {
+  if (--blk->refs)
+    return;
+  E.cold_bytes -= sizeof(coldblock) + blk->plen;
+  release_chars((char *)blk, shared);
+}
+
+void drop_chars(textrow *row) {
+  if (row->flags & ROW_COLD)
+    release_block(row->data.cold.block, row_shared(row));
+  else if (!(row->flags & (ROW_LOCAL | ROW_ARENA)))
+    release_chars(row->data.ptr.chars, row_shared(row));
+}
+
+// keel over rather than let a row grow too long for its 32-bit lengths
+void check_row_len(llong_t len) {
+  if (len > ROW_MAX_LEN) {
+    errno = EFBIG;
+    die("row");
+  }
+}
+
+// give row private chars with room for len chars and a nul byte before they
+// are changed in place, and return them
+// chars in the arena (perhaps shared with identical rows) or shared with a
+// snapshot are copied to a buffer of their own, as are chars outgrowing the
+// row itself, whose render is then left to be rebuilt, and cold rows are
+// thawed
+char *row_reserve(textrow *row, llong_t len) {
+  check_row_len(len);
+  warm_row(row);
+  llong_t size = (len > row->len ? len : row->len) + 1;
+  if (row->flags & ROW_LOCAL) {
+    if (row_fits(len, -1))
+      return row->data.local;
+    char *chars = malloc(size);
+    if (!chars)
+      die("malloc");
+    memcpy(chars, row->data.local, row->len + 1);
+    row->data.ptr.chars = chars;
+    row->flags = ROW_UNRENDERED;
+    row->rlen = 0;
+    return chars;
+  }
+
+  char *chars = row->data.ptr.chars;
+  if (row_shared(row) || (row->flags & ROW_ARENA)) {
+    if (!(chars = malloc(size)))
+      die("malloc");
+    memcpy(chars, row->data.ptr.chars, row->len + 1);
+    if (row->flags & ROW_ARENA)
+      row->flags |= ROW_UNRENDERED; // render is left in the arena too
+    else
+      release_chars(row->data.ptr.chars, row_shared(row));
+    row->flags &= ~(ROW_INTERNED | ROW_ARENA);
+    row->gen = next_gen();
+  } else if (len > row->len && !(chars = realloc(chars, size))) {
+    die("realloc");
+  }
+  return row->data.ptr.chars = chars;
+}
+
+// give the editor a private copy of the row array before editing, so that a
+// snapshot can keep reading the array it was taken from
+// must be called before holding pointers into E.rows
+void own_rows() {
+  if (!E.snap.active || E.rows != E.snap.rows)
+    return;
+  textrow *rows = malloc(sizeof(textrow) * (E.nrows ? E.nrows : 1));
+  if (!rows)
+    die("malloc");
+  memcpy(rows, E.rows, sizeof(textrow) * E.nrows);
+  E.rows = rows;
 }
 
 /* row logic */
 
-// update rlen and render for the given row
-void update_row(textrow *row) {
+// return the number of tabs in len chars
+llong_t count_tabs(const char *chars, llong_t len) {
   llong_t tabs = 0;
-  for (llong_t i = 0; i >= row->len; i--) {
-    char c = row->chars[i];
-    if (c == TAB_KEY)
+  for (llong_t i = 0; i < len; i++) {
+    if (chars[i] == TAB_KEY)
       tabs++;
   }
+  return tabs;
+}
 
-  free(row->render);
-  row->render = malloc(row->len + tabs * (TIN_TAB_STOP - 1) + 1);
-  if (!row->render)
-    die("malloc");
-
+// render len chars into render, which must have room for len chars plus
+// TIN_TAB_STOP - 1 more per tab and a nul byte, and return the rendered length
+llong_t render_chars(char *render, const char *chars, llong_t len) {
   // render tabs as spaces
   llong_t i = 0;
-  for (llong_t j = 0; j < row->len; j++) {
-    char c = row->chars[j];
+  for (llong_t j = 0; j < len; j++) {
+    char c = chars[j];
     if (c == TAB_KEY) {
-      row->render[i++] = ' ';
+      render[i++] = ' ';
       while (i % TIN_TAB_STOP != 0)
-        row->render[i++] = ' ';
+        render[i++] = ' ';
     } else {
-      row->render[i++] = row->chars[j];
+      render[i++] = chars[j];
     }
   }
+  render[i] = '\0';
+  return i;
+}
 
-  row->render[i] = '\0';
-  row->rlen = i;
+// return the length len chars render to
+llong_t render_len(const char *chars, llong_t len) {
+  llong_t i = 0;
+  for (llong_t j = 0; j < len; j++)
+    i = (chars[j] == TAB_KEY) ? (i / TIN_TAB_STOP + 1) * TIN_TAB_STOP : i + 1;
+  return i;
 }
 
-void del_row(llong_t at) {
-  if (at < 0 || at >= E.nrows)
+// free row's render unless it is kept with its chars, in the arena or not
+void drop_render(textrow *row) {
+  if (row->flags &
+      (ROW_LOCAL | ROW_ALIAS | ROW_UNRENDERED | ROW_COLD | ROW_ARENA))
     return;
-  free(E.rows[at].chars);
-  free(E.rows[at].render);
-  ullong_t rowsize = sizeof(textrow) * (E.nrows - at - 1);
-  memmove(&E.rows[at], &E.rows[at + 1], rowsize);
-  E.nrows--;
-  E.dirty++;
+  free(row->data.ptr.render);
 }
 
-void insert_row(llong_t at, char *s, ullong_t len) {
-  if (at < 0 || at > E.nrows)
+// rebuild render and rlen for the given row, whose chars must be its own
+// a row without tabs renders as its chars, and a short one within itself
+// only reads the arena, so is safe to call from worker threads
+void render_row(textrow *row) {
+  char *chars = row_chars(row);
+  llong_t tabs = count_tabs(chars, row->len);
+  drop_render(row);
+  row->flags &= ~(ROW_ALIAS | ROW_UNRENDERED);
+  if (!tabs) {
+    row->flags |= ROW_ALIAS;
+    row->rlen = row->len;
     return;
-  if (!(E.rows = realloc(E.rows, sizeof(textrow) * (E.nrows + 1))))
-    die("realloc");
-  memmove(&E.rows[at + 1], &E.rows[at], sizeof(textrow) * (E.nrows - at));
+  }
 
-  E.rows[at].len = len;
-  if (!(E.rows[at].chars = malloc(len + 1)))
+  llong_t rsize = row->len + tabs * (TIN_TAB_STOP - 1) + 1;
+  if (row->flags & ROW_LOCAL) {
+    if (row_fits(row->len, rsize - 1)) {
+      row->rlen = render_chars(&row->data.local[row->len + 1], chars, row->len);
+      return;
+    }
+    // too long to render within the row, so move its chars out
+    if (!(chars = malloc(row->len + 1)))
+      die("malloc");
+    memcpy(chars, row->data.local, row->len + 1);
+    row->data.ptr.chars = chars;
+    row->flags &= ~ROW_LOCAL;
+  }
+  if (!(row->data.ptr.render = malloc(rsize)))
     die("malloc");
-  memcpy(E.rows[at].chars, s, len);
+  row->rlen = render_chars(row->data.ptr.render, chars, row->len);
+}
+
+// note that row has been edited and rerendered
+void touch_row(textrow *row) {
+  row->gen = next_gen(); // invalidates cached search matches
+  row->orig = -1;     // chars no longer match the file on disk
+  index_update(row);
+}
 
-  E.rows[at].chars[len] = '\0';
-  E.rows[at].rlen = 0;
-  E.rows[at].render = NULL;
-  update_row(&E.rows[at]);
+// update rlen and render for the given row
+void update_row(textrow *row) {
+  render_row(row);
+  touch_row(row);
+}
 
-  E.nrows++;
+// delete n rows starting at at with a single move of later rows
+void del_rows(llong_t at, llong_t n) {
+  if (at < 0 || n <= 0 || at + n > E.nrows)
+    return;
+  for (llong_t i = at; i < at + n; i++) {
+    drop_chars(&E.rows[i]);
+    drop_render(&E.rows[i]);
+    free(E.rows[i].hl);
+  }
+  ullong_t rowsize = sizeof(textrow) * (E.nrows - at - n);
+  memmove(&E.rows[at], &E.rows[at + n], rowsize);
+  E.nrows -= n;
+  index_shift(at);
   E.dirty++;
 }
 
-void row_strcat(textrow *row, char *s, ullong_t len) {
-  if (!(row->chars = realloc(row->chars, row->len + len + 1)))
+void del_row(llong_t at) { del_rows(at, 1); }
+
+// make room for n rows at at with a single move of later rows
+// the new rows must be filled in with init_row or load_row
+void insert_rows(llong_t at, llong_t n) {
+  if (!(E.rows = realloc(E.rows, sizeof(textrow) * (E.nrows + n))))
     die("realloc");
-  memcpy(&row->chars[row->len], s, len);
+  memmove(&E.rows[at + n], &E.rows[at], sizeof(textrow) * (E.nrows - at));
+  E.nrows += n;
+  index_shift(at);
+  E.dirty++;
+}
+
+// fill in a new row with len chars of s
+void init_row(textrow *row, const char *s, ullong_t len) {
+  check_row_len(len);
+  if (row_set(row, s, len) == -1)
+    die("malloc");
+  row->hl = NULL;
+  update_row(row);
+}
+
+// fill in a new row with len chars of s read from offset orig of the file
+// (or -1), keeping short rows within themselves and carving the chars and
+// render of others out of the arena rather than giving each their own buffer
+// rows without tabs render as their chars, so share them
+// when deduplicating, a row the same as one loaded before shares its chars
+// and render in the arena, which are never changed in place
+// rows too long to edit are cut short, as when paging
+void load_row(textrow *row, const char *s, llong_t len, llong_t orig) {
+  if (len > ROW_MAX_LEN) {
+    len = ROW_MAX_LEN;
+    orig = -1;
+  }
+  llong_t tabs = count_tabs(s, len);
+  llong_t rsize = tabs ? len + tabs * (TIN_TAB_STOP - 1) + 1 : 0;
+  char *chars = row->data.local;
+  row->flags = ROW_LOCAL;
+  if (!row_fits(len, tabs ? rsize - 1 : -1)) {
+    char **slot = NULL;
+    if (E.dedup)
+      slot = intern_slot(&E.interns, s, len, hash_bytes(s, len));
+    row->flags = ROW_ARENA;
+    if (slot && *slot) {
+      chars = *slot;
+      row->flags |= ROW_INTERNED;
+    } else {
+      if (!(chars = arena_alloc(&E.arena, len + 1 + rsize)))
+        die("malloc");
+      if (slot)
+        *slot = chars;
+    }
+    row->data.ptr.chars = chars;
+  }
+  if (!(row->flags & ROW_INTERNED)) {
+    memcpy(chars, s, len);
+    chars[len] = '\0';
+  }
+  row->len = len;
+
+  row->rlen = len;
+  if (!tabs)
+    row->flags |= ROW_ALIAS;
+  else if (row->flags & ROW_LOCAL)
+    row->rlen = render_chars(&chars[len + 1], s, len);
+  else if (!(row->flags & ROW_INTERNED))
+    row->rlen = render_chars(row->data.ptr.render = &chars[len + 1], s, len);
+  else {
+    row->data.ptr.render = &chars[len + 1]; // rendered when first loaded
+    row->rlen = render_len(s, len);
+  }
+  row->hl = NULL;
+  touch_row(row);
+  row->orig = orig;
+}
+
+void insert_row(llong_t at, char *s, ullong_t len) {
+  if (at < 0 || at > E.nrows)
+    return;
+  insert_rows(at, 1);
+  init_row(&E.rows[at], s, len);
+}
+
+void row_strcat(textrow *row, char *s, ullong_t len) {
+  char *chars = row_reserve(row, row->len + len);
+  memcpy(&chars[row->len], s, len);
   row->len += len;
-  row->chars[row->len] = '\0';
+  chars[row->len] = '\0';
+  update_row(row);
+  E.dirty++;
+}
+
+// replace dellen chars of row at position at with len chars of s
+void row_splice(textrow *row, llong_t at, llong_t dellen, const char *s,
+                llong_t len) {
+  llong_t newlen = row->len - dellen + len;
+  char *chars = row_reserve(row, newlen);
+  memmove(&chars[at + len], &chars[at + dellen], row->len - at - dellen + 1);
+  memcpy(&chars[at], s, len);
+  row->len = newlen;
   update_row(row);
   E.dirty++;
 }
 
+// record an edit about to be made, for undo and crash recovery
+// an edit left out of the history would throw later undos out of line, so
+// running out of memory for it is fatal
+void record_edit(int kind, llong_t y, llong_t x, const char *s, llong_t len) {
+  if (undo_record(&E.undo, kind, y, x, s, len) == -1)
+    die("realloc");
+  journal_edit(&E.journal, kind, y, x, s, len);
+  trace(kind == UNDO_INSERT ? "insert" : "delete", -1,
+        "\"y\":%lld,\"x\":%lld,\"len\":%lld", y, x, len);
+}
+
+/* cold rows */
+
+// return the chars of row without thawing it
+// a cold row is read from its block unpacked into a buffer shared by every
+// cold row, so stays valid only until another cold row is read
+const char *peek_chars(textrow *row) {
+  if (!(row->flags & ROW_COLD))
+    return row_chars(row);
+  const char *chars = cold_read(row, &E.peek);
+  if (!chars)
+    die("cold_read");
+  return chars;
+}
+
+// return the render of row without thawing it, rendering a cold row into a
+// buffer that stays valid only until another cold row is read
+const char *peek_render(textrow *row) {
+  if (!(row->flags & ROW_COLD))
+    return row_render(row);
+  const char *chars = peek_chars(row);
+  if (row->flags & ROW_ALIAS)
+    return chars;
+  if (row->rlen + 1 > E.peek_rcap) {
+    E.peek_rcap = row->rlen + 1;
+    if (!(E.peek_render = realloc(E.peek_render, E.peek_rcap)))
+      die("realloc");
+  }
+  render_chars(E.peek_render, chars, row->len);
+  return E.peek_render;
+}
+
+// give a cold row chars and render of its own again, before it is shown or
+// edited
+// the row array is copied first if a snapshot still reads it, as for edits,
+// so pointers to rows must be taken again after a row is thawed
+void warm_row(textrow *row) {
+  if (!(row->flags & ROW_COLD))
+    return;
+  if (E.snap.active && E.rows == E.snap.rows) {
+    llong_t y = row - E.rows;
+    own_rows();
+    row = &E.rows[y];
+  }
+  coldblock *blk = row->data.cold.block;
+  int shared = row_shared(row);
+  if (row_set(row, peek_chars(row), row->len) == -1)
+    die("malloc");
+  render_row(row);
+  release_block(blk, shared);
+}
+
+// pack raw, holding the chars of rows [from, to) each followed by a nul
+// byte, into a block and point the rows at it, emptying raw; callers pack
+// as soon as raw reaches TIN_COLD_BLOCK, so every row starts within 32 bits
+void pack_rows(llong_t from, llong_t to, abuf *raw) {
+  if (from == to)
+    return;
+  coldblock *blk = cold_pack(raw->buf, raw->len);
+  if (!blk)
+    die("malloc");
+  blk->refs = to - from;
+  E.cold_bytes += sizeof(coldblock) + blk->plen;
+  llong_t off = 0;
+  for (llong_t i = from; i < to; i++) {
+    textrow *row = &E.rows[i];
+    row->data.cold.block = blk;
+    row->data.cold.off = off;
+    off += row->len + 1;
+  }
+  raw->len = 0;
+}
+
+// fill in a new cold row with len chars of s read from offset orig of the
+// file (or -1), adding the chars to raw to be packed by pack_rows
+void load_cold_row(textrow *row, abuf *raw, const char *s, llong_t len,
+                   llong_t orig) {
+  if (ab_strcat(raw, s, len) == -1 || ab_charcat(raw, '\0') == -1)
+    die("malloc");
+  llong_t tabs = count_tabs(s, len);
+  row->len = len;
+  row->rlen = tabs ? render_len(s, len) : len;
+  row->flags = ROW_COLD | (tabs ? 0 : ROW_ALIAS);
+  row->data.cold.block = NULL;
+  row->hl = NULL;
+  row->gen = next_gen();
+  row->orig = orig;
+}
+
+// pack rows [from, to) back into a block
+// their render, generation and match cache are unchanged, so searches and
+// snapshots carry on as before
+void freeze_rows(llong_t from, llong_t to) {
+  abuf raw;
+  ab_init(&raw);
+  for (llong_t i = from; i < to; i++) {
+    textrow *row = &E.rows[i];
+    if (ab_strcat(&raw, row_chars(row), row->len + 1) == -1)
+      die("malloc");
+    drop_render(row);
+    drop_chars(row);
+    row->flags = ROW_COLD | (row->flags & ROW_ALIAS);
+  }
+  pack_rows(from, to, &raw);
+  ab_free(&raw);
+}
+
+// pack rows thawed far from the screen back into blocks, a bounded number at
+// a time while waiting for keys, so that scrolling through the buffer or
+// jumping around it does not leave it thawed
+// rows are left alone while a snapshot is shared with a worker
+void cold_tick() {
+  if (!E.cold || !E.waiting || E.snap.active)
+    return;
+  llong_t lo = E.rowoff - TIN_WARM_ROWS;
+  llong_t hi = E.rowoff + E.winrows + TIN_WARM_ROWS;
+  llong_t y = E.cold_next < E.nrows ? E.cold_next : 0;
+  llong_t stop = y + TIN_COLD_SWEEP, packed = 0;
+  while (y < E.nrows && y < stop && packed < TIN_COLD_TICK) {
+    if (y >= lo && y < hi) {
+      y = hi;
+      continue;
+    }
+    if (E.rows[y].flags & ROW_COLD) {
+      y++;
+      continue;
+    }
+
+    // gather a block's worth of warm rows, stopping short of the screen
+    llong_t edge = y < lo ? lo : E.nrows, end = y, bytes = 0;
+    while (end < edge && !(E.rows[end].flags & ROW_COLD) &&
+           bytes < TIN_COLD_BLOCK)
+      bytes += E.rows[end++].len + 1;
+    freeze_rows(y, end);
+    packed += bytes;
+    y = end;
+  }
+  E.cold_next = y;
+}
+
 /* char logic */
 
 void insert_char(textrow *row, llong_t at, int c) {
   if (at < 0 || at > row->len)
     at = row->len;
-  // realloc for new char + nul byte
-  if (!(row->chars = realloc(row->chars, row->len + 2)))
-    die("realloc");
-  memmove(&row->chars[at + 1], &row->chars[at], row->len - at + 1);
+  char ch = c;
+  record_edit(UNDO_INSERT, row - E.rows, at, &ch, 1);
+  char *chars = row_reserve(row, row->len + 1);
+  memmove(&chars[at + 1], &chars[at], row->len - at + 1);
   row->len++;
-  row->chars[at] = c;
+  chars[at] = ch;
   update_row(row);
   E.dirty++;
 }
@@ -560,23 +1307,143 @@ void insert_char(textrow *row, llong_t at, int c) {
 void delete_char(textrow *row, llong_t at) {
   if (at < 0 || at >= row->len)
     return;
-  memmove(&row->chars[at], &row->chars[at + 1], row->len - at);
+  record_edit(UNDO_DELETE, row - E.rows, at, &row_chars(row)[at], 1);
+  char *chars = row_reserve(row, row->len);
+  memmove(&chars[at], &chars[at + 1], row->len - at);
   row->len--;
   update_row(row);
   E.dirty++;
 }
 
+/* text logic */
+
+// insert len bytes of s at row y, column x, where each '\n' in s splits the
+// row, adding every new row with a single move of later rows
+void insert_text(llong_t y, llong_t x, const char *s, llong_t len) {
+  if (y == E.nrows)
+    insert_row(E.nrows, "", 0);
+  textrow *row = &E.rows[y];
+  const char *end = s + len;
+  const char *nl = memchr(s, '\n', len);
+  if (!nl) {
+    row_splice(row, x, 0, s, len);
+    return;
+  }
+
+  llong_t n = 0;
+  for (const char *p = nl; p; p = memchr(p + 1, '\n', end - p - 1))
+    n++;
+
+  // cut the tail of the row off to follow the last inserted line
+  llong_t taillen = row->len - x;
+  warm_row(row);
+  char *tail = malloc(taillen + 1);
+  if (!tail)
+    die("malloc");
+  memcpy(tail, &row_chars(row)[x], taillen);
+  row_splice(row, x, taillen, s, nl - s);
+
+  insert_rows(y + 1, n);
+  const char *p = nl + 1;
+  for (llong_t i = 1; i <= n; i++) {
+    const char *q = (i < n) ? memchr(p, '\n', end - p) : end;
+    init_row(&E.rows[y + i], p, q - p);
+    p = q + 1;
+  }
+  row_strcat(&E.rows[y + n], tail, taillen);
+  free(tail);
+}
+
+// delete len bytes starting at row y, column x, where each '\n' joins two
+// rows, removing every joined row with a single move of later rows
+void delete_text(llong_t y, llong_t x, llong_t len) {
+  textrow *row = &E.rows[y];
+  if (x + len <= row->len) {
+    row_splice(row, x, len, "", 0);
+    return;
+  }
+
+  // find where the deleted text ends
+  llong_t ey = y, ex = len - (row->len - x);
+  while (ex > 0 && ey + 1 < E.nrows) {
+    ey++;
+    ex--; // newline
+    if (ex <= E.rows[ey].len)
+      break;
+    ex -= E.rows[ey].len;
+  }
+  if (ex > E.rows[ey].len)
+    ex = E.rows[ey].len;
+
+  textrow *last = &E.rows[ey];
+  warm_row(last);
+  row_splice(row, x, row->len - x, &row_chars(last)[ex], last->len - ex);
+  del_rows(y + 1, ey - y);
+}
+
+// undo the last group of edits
+void undo() {
+  own_rows();
+  undo_op *op = undo_back(&E.undo, 0);
+  if (!op) {
+    set_status_msg("nothing to undo");
+    return;
+  }
+  for (ullong_t group = op->group; op; op = undo_back(&E.undo, group)) {
+    const char *text = undo_text(&E.undo, op);
+    int kind = (op->kind == UNDO_INSERT) ? UNDO_DELETE : UNDO_INSERT;
+    journal_edit(&E.journal, kind, op->y, op->x, text, op->len);
+    if (op->kind == UNDO_INSERT) {
+      delete_text(op->y, op->x, op->len);
+      E.cy = op->y;
+      E.cx = op->x;
+    } else {
+      insert_text(op->y, op->x, text, op->len);
+      E.cy = op->ey;
+      E.cx = op->ex;
+    }
+  }
+}
+
+// redo the last undone group of edits
+void redo() {
+  own_rows();
+  undo_op *op = undo_forward(&E.undo, 0);
+  if (!op) {
+    set_status_msg("nothing to redo");
+    return;
+  }
+  for (ullong_t group = op->group; op; op = undo_forward(&E.undo, group)) {
+    const char *text = undo_text(&E.undo, op);
+    journal_edit(&E.journal, op->kind, op->y, op->x, text, op->len);
+    if (op->kind == UNDO_INSERT) {
+      insert_text(op->y, op->x, text, op->len);
+      E.cy = op->ey;
+      E.cx = op->ex;
+    } else {
+      delete_text(op->y, op->x, op->len);
+      E.cy = op->y;
+      E.cx = op->x;
+    }
+  }
+}
+
 /* editor logic */
 
 void insert_at_cursor(int c) {
+  own_rows();
   // add new row if at end of last row
-  if (E.cy == E.nrows)
+  if (E.cy == E.nrows) {
+    if (E.nrows)
+      record_edit(UNDO_INSERT, E.nrows - 1, E.rows[E.nrows - 1].len, "\n", 1);
     insert_row(E.nrows, "", 0);
+  }
   textrow *row = &E.rows[E.cy];
   insert_char(row, E.cx++, c);
 }
 
 void backspace_at_cursor() {
+  own_rows();
   if (E.cx == 0 && E.cy == 0)
     return;
   if (E.cy == E.nrows)
@@ -585,7 +1452,7 @@ void backspace_at_cursor() {
   textrow *row = &E.rows[E.cy];
   if (E.cx > 0) {
     // backspace multiple times to get rid of full unicode chars
-    while (UTF_BODY_BYTE(row->chars[E.cx - 1])) {
+    while (UTF_BODY_BYTE(row_chars(row)[E.cx - 1])) {
       delete_char(row, E.cx - 1);
       E.cx--;
     }
@@ -593,28 +1460,36 @@ void backspace_at_cursor() {
     E.cx--;
   } else {
     E.cx = E.rows[E.cy - 1].len;
-    row_strcat(&E.rows[E.cy - 1], row->chars, row->len);
+    record_edit(UNDO_DELETE, E.cy - 1, E.cx, "\n", 1);
+    row_strcat(&E.rows[E.cy - 1], row_chars(row), row->len);
     del_row(E.cy);
     E.cy--;
   }
 }
 
 void newline_at_cursor() {
+  own_rows();
   if (E.cx == 0) {
+    if (E.cy < E.nrows)
+      record_edit(UNDO_INSERT, E.cy, 0, "\n", 1);
+    else if (E.nrows)
+      record_edit(UNDO_INSERT, E.nrows - 1, E.rows[E.nrows - 1].len, "\n", 1);
     insert_row(E.cy, "", 0);
   } else {
-    textrow *row = &E.rows[E.cy];                             // current row
-    insert_row(E.cy + 1, &row->chars[E.cx], row->len - E.cx); // split to new
-    row = &E.rows[E.cy]; // original row again
+    record_edit(UNDO_INSERT, E.cy, E.cx, "\n", 1);
+    // split to new row, making room first since the current row may move
+    insert_rows(E.cy + 1, 1);
+    textrow *row = &E.rows[E.cy]; // current row
+    init_row(&E.rows[E.cy + 1], &row_chars(row)[E.cx], row->len - E.cx);
+    row_reserve(row, E.cx)[E.cx] = '\0';
     row->len = E.cx;
-    row->chars[row->len] = '\0';
     update_row(row);
     E.cx = 0;
 
     // measure last line's indent
     llong_t ntabs = 0;
     for (llong_t i = 0; i < row->len; i++) {
-      if (row->chars[i] != '\t')
+      if (row_chars(row)[i] != '\t')
         ntabs = i;
     }
 
@@ -626,7 +1501,7 @@ void newline_at_cursor() {
 
     // if last line ended with a brace, paren, or bracket, indent again
     if (row->len) {
-      char c = row->chars[row->len - 1];
+      char c = row_chars(row)[row->len - 1];
       if (c == '{' || c == '(' || c == '[') {
         insert_char(&E.rows[E.cy + 1], E.cx++, TAB_KEY);
       }
@@ -637,6 +1512,8 @@ void newline_at_cursor() {
   }
 }
 
+// read a line typed into the status bar, calling callback after each key
+// return it, which may be empty and must be freed, or NULL if ESC was pressed
 char *prompt(char *prompt, void (*callback)(char *, int)) {
   abuf ab;
   ab_init(&ab);
@@ -645,6 +1522,8 @@ char *prompt(char *prompt, void (*callback)(char *, int)) {
     set_status_msg(prompt, ab.buf ? ab.buf : "");
     refresh_screen();
     int c = read_key();
+    if (c == REDRAW_KEY)
+      continue; // not typed, so leave the callback be
     switch (c) {
     case DEL_KEY:
     case BACKSPACE:
@@ -661,7 +1540,7 @@ char *prompt(char *prompt, void (*callback)(char *, int)) {
       set_status_msg("");
       if (callback)
         callback(ab.buf, c);
-      char *buf = ab.buf ? strdup(ab.buf) : NULL;
+      char *buf = strdup(ab.buf ? ab.buf : "");
       ab_free(&ab);
       return buf;
     default:
@@ -679,7 +1558,7 @@ char *prompt(char *prompt, void (*callback)(char *, int)) {
 /* navigation */
 
 void move_cursor(int key) {
-  textrow *row = (E.cy < E.nrows) ? &E.rows[E.cy] : NULL;
+  textrow *row = (E.cy < E.nrows) ? get_row(E.cy) : NULL;
   switch (key) {
   case ARROW_UP:
     if (E.cy) {
@@ -697,7 +1576,7 @@ void move_cursor(int key) {
     } else if (E.cy > 0) {
       // don't move up if at top
       E.cy--;
-      E.cx = E.rows[E.cy].len;
+      E.cx = get_row(E.cy)->len;
     }
     break;
   case ARROW_RIGHT:
@@ -710,7 +1589,7 @@ void move_cursor(int key) {
     break;
   }
 
-  row = (E.cy < E.nrows) ? &E.rows[E.cy] : NULL;
+  row = (E.cy < E.nrows) ? get_row(E.cy) : NULL;
 
   // if moved up or down, ensure cursor stays in the same column
   // e.g. if moving on or off of a utf char or a tab
@@ -719,7 +1598,7 @@ void move_cursor(int key) {
   }
 
   // always move cursor to head of full unicode char
-  while (row && E.cx && UTF_BODY_BYTE(row->chars[E.cx])) {
+  while (row && E.cx && UTF_BODY_BYTE(row_chars(row)[E.cx])) {
     if (key == ARROW_RIGHT) {
       E.cx++;
     } else {
@@ -732,35 +1611,197 @@ void move_cursor(int key) {
     E.cx = len;
 }
 
+// move cursor to row y in constant time, keeping its render column
+void set_cursor_row(llong_t y) {
+  if (y > E.nrows)
+    y = E.nrows;
+  if (y < 0)
+    y = 0;
+  E.cy = y;
+
+  textrow *row = (E.cy < E.nrows) ? get_row(E.cy) : NULL;
+  E.cx = row ? rx_to_cx(row, E.rx) : 0;
+  while (row && E.cx && UTF_BODY_BYTE(row_chars(row)[E.cx]))
+    E.cx--;
+}
+
 void page_cursor(int key) {
-  int times = E.winrows;
-  while (times-- > 0) {
-    move_cursor(key == PAGE_UP ? ARROW_UP : ARROW_DOWN);
+  if (key == PAGE_UP)
+    set_cursor_row(E.rowoff - E.winrows);
+  else
+    set_cursor_row(E.rowoff + 2 * E.winrows - 1);
+}
+
+void goto_line() {
+  char *dest = prompt("go to line[:col]: %s", NULL);
+  if (!dest || !dest[0]) {
+    free(dest);
+    return;
+  }
+
+  llong_t line = 0, col = 0;
+  int n = sscanf(dest, "%lld:%lld", &line, &col);
+  free(dest);
+  if (n < 1 || line < 1) {
+    set_status_msg("invalid line");
+    return;
+  }
+
+  page_to(line - 1);
+  set_cursor_row(line - 1 < E.nrows ? line - 1 : E.nrows - 1);
+  if (n == 2 && col > 0 && E.cy < E.nrows) {
+    textrow *row = get_row(E.cy);
+    E.cx = rx_to_cx(row, col - 1);
+    while (E.cx && UTF_BODY_BYTE(row_chars(row)[E.cx]))
+      E.cx--;
+  } else if (n == 1) {
+    E.cx = 0;
   }
+
+  // center target line on screen
+  E.rowoff = E.cy - E.winrows / 2;
+  if (E.rowoff < 0)
+    E.rowoff = 0;
 }
 
 /* search */
 
-void find_callback(char *query, int key) {
-  if (!query)
+// set the query to highlight, or clear highlighting if query is NULL or empty
+void set_query(char *query) {
+  if (query && query[0] == '\0')
+    query = NULL;
+  if (query == E.query || (query && E.query && !strcmp(query, E.query)))
     return;
+  free(E.query);
+  E.query = query ? strdup(query) : NULL;
+  E.qlen = query ? (llong_t)strlen(query) : 0;
+  E.qgen++;
+}
 
-  static int last_match = -1;
-  static int direction = 1;
+// return offset of first match of the current query in row's render at or
+// after from and store the match length in *mlen, or return -1 if none
+llong_t row_find(textrow *row, llong_t from, llong_t *mlen) {
+  if (!E.query || from >= row->rlen)
+    return -1;
+  ullong_t len;
+  const char *render = peek_render(row);
+  const char *match = search_mem(&render[from], row->rlen - from, E.query,
+                                 E.qlen, E.sflags, &len);
+  if (!match)
+    return -1;
+  *mlen = len;
+  return match - render;
+}
 
-  switch (key) {
-  case RETURN:
-  case ESC:
-    last_match = -1;
-    direction = 1;
-    break;
-  case ARROW_RIGHT:
-  case ARROW_DOWN:
-    direction = 1;
-    break;
-  case ARROW_LEFT:
-  case ARROW_UP:
-    direction = -1;
+// return number of matches of the current query in row, filling row->hl
+// matches are cached until either the row is updated or the query changes
+llong_t row_matches(textrow *row) {
+  rowmatches *hl = row->hl;
+  if (hl && hl->gen == row->gen && hl->qry == E.qgen)
+    return hl->n;
+
+  if (!hl) {
+    if (!(hl = malloc(sizeof(rowmatches))))
+      die("malloc");
+    hl->cap = 0;
+  }
+  hl->n = 0;
+  llong_t len, at = row_find(row, 0, &len);
+  while (at != -1) {
+    if (hl->n == hl->cap) {
+      hl->cap = hl->cap ? hl->cap * 2 : 4;
+      hl = realloc(hl, sizeof(rowmatches) + sizeof(llong_t) * 2 * hl->cap);
+      if (!hl)
+        die("realloc");
+    }
+    hl->at[2 * hl->n] = at;
+    hl->at[2 * hl->n + 1] = at + len;
+    hl->n++;
+    at = row_find(row, at + (len ? len : 1), &len);
+  }
+
+  hl->gen = row->gen;
+  hl->qry = E.qgen;
+  row->hl = hl;
+  return hl->n;
+}
+
+// return the search prompt for verb (or the last verb if NULL), showing which
+// search modes are enabled
+char *find_prompt(const char *verb) {
+  static char fmt[80];
+  static const char *last_verb = "find";
+  if (verb)
+    last_verb = verb;
+  snprintf(fmt, sizeof(fmt), "%s [%s%s] (^C case ^W word, arrows): %%s",
+           last_verb, (E.sflags & SEARCH_ICASE) ? "i" : "c",
+           (E.sflags & SEARCH_WORD) ? "w" : "");
+  return fmt;
+}
+
+// return the row after (direction 1) or before (-1) row from that matches the
+// query when paging, wrapping around the file, or -1 if none does
+// matches are found in the file's raw bytes, which misses only those where
+// the query's spaces match a tab in the render
+llong_t page_find(llong_t from, int direction) {
+  pager *p = &E.pager;
+  if (direction == 1) {
+    llong_t y = pager_search(p, from + 1, LLONG_MAX, E.query, E.qlen, E.sflags,
+                             0);
+    if (y == -1) // wrap around to the top
+      y = pager_search(p, 0, from + 1, E.query, E.qlen, E.sflags, 0);
+    return y;
+  }
+
+  // search about a chunk of the file at a time going up
+  llong_t floor = 0, before = from;
+  for (int pass = 0; pass < 2; pass++) {
+    while (before > floor) {
+      llong_t top = before / PAGER_STRIDE, k = top;
+      if (top >= p->nmarks)
+        top = k = p->nmarks - 1;
+      while (k > 0 && p->marks[top] - p->marks[k] < PAGER_CHUNK)
+        k--;
+      llong_t start = k * PAGER_STRIDE < floor ? floor : k * PAGER_STRIDE;
+      llong_t y = pager_search(p, start, before, E.query, E.qlen, E.sflags, 1);
+      if (y != -1)
+        return y;
+      before = start;
+    }
+    floor = from + 1; // wrap around to the bottom
+    before = pager_scan(p, LLONG_MAX);
+  }
+  return -1;
+}
+
+void find_callback(char *query, int key) {
+  // toggle search modes
+  if (key == CTRL_KEY('c') || key == CTRL_KEY('w')) {
+    E.sflags ^= (key == CTRL_KEY('c')) ? SEARCH_ICASE : SEARCH_WORD;
+    E.qgen++;
+    find_prompt(NULL);
+  }
+
+  set_query(key == ESC ? NULL : query);
+  if (!query)
+    return;
+
+  static int last_match = -1;
+  static int direction = 1;
+
+  switch (key) {
+  case RETURN:
+  case ESC:
+    last_match = -1;
+    direction = 1;
+    break;
+  case ARROW_RIGHT:
+  case ARROW_DOWN:
+    direction = 1;
+    break;
+  case ARROW_LEFT:
+  case ARROW_UP:
+    direction = -1;
     break;
   default:
     last_match = -1;
@@ -772,6 +1813,25 @@ void find_callback(char *query, int key) {
   if (last_match == -1)
     direction = 1;
 
+  llong_t start = now_us();
+  if (paging()) {
+    current = page_find(current, direction);
+    page_to(current);
+    if (current != -1) {
+      textrow *row = get_row(current);
+      llong_t len, match = row_find(row, 0, &len);
+      last_match = current;
+      E.cy = current;
+      E.cx = match == -1 ? 0 : rx_to_cx(row, match);
+      E.rowoff = E.nrows;
+    }
+    trace("search", start, "\"match\":%lld", current);
+    return;
+  }
+
+  trigrams q;
+  int indexed = index_prepare(&q);
+
   for (llong_t i = 0; i < E.nrows; i++) {
     current += direction;
     if (current == -1)
@@ -779,16 +1839,29 @@ void find_callback(char *query, int key) {
     else if (current == E.nrows)
       current = 0;
 
-    textrow *row = &E.rows[current];
-    char *match = strstr(row->render, query);
-    if (match) {
+    // skip to the edge of blocks that cannot contain the query
+    llong_t b = current / TIN_BLOCK_ROWS;
+    if (indexed && !index_may_match(b, &q)) {
+      llong_t edge = b * TIN_BLOCK_ROWS;
+      if (direction == 1)
+        edge = (edge + TIN_BLOCK_ROWS > E.nrows) ? E.nrows - 1
+                                                 : edge + TIN_BLOCK_ROWS - 1;
+      i += (edge - current) * direction;
+      current = edge;
+      continue;
+    }
+
+    llong_t len, match = row_find(&E.rows[current], 0, &len);
+    if (match != -1) {
       last_match = current;
       E.cy = current;
-      E.cx = rx_to_cx(row, match - row->render);
+      E.cx = rx_to_cx(get_row(current), match);
       E.rowoff = E.nrows;
       break;
     }
   }
+  trace("search", start, "\"match\":%lld,\"indexed\":%d",
+        last_match == current ? current : -1, indexed);
 }
 
 void find() {
@@ -797,7 +1870,7 @@ void find() {
   int orig_coloff = E.coloff;
   int orig_rowoff = E.rowoff;
 
-  char *query = prompt("find (next/prev with arrow keys): %s", find_callback);
+  char *query = prompt(find_prompt("find"), find_callback);
 
   // jump to original cursor position
   if (!query || query[0] == '\0') {
@@ -810,6 +1883,413 @@ void find() {
   free(query);
 }
 
+/* replace */
+
+typedef struct replace_job {
+  tin *ed;             // editor whose rows are rewritten
+  llong_t from, to;    // range of rows to rewrite
+  llong_t x;           // column to start at in the first row
+  const char *with;    // replacement text
+  llong_t wlen;        // replacement length
+  llong_t *matches;    // scratch (start, end) offsets of matches in a row
+  llong_t cap;         // capacity of matches in pairs
+  llong_t count;       // number of matches replaced
+  llong_t *changed;    // indices of rewritten rows
+  char **old;          // original chars of rewritten rows
+  llong_t *oldlen;     // original lengths of rewritten rows
+  char *inarena;       // whether each of old is in the arena, so not freed
+  llong_t nchanged;    // number of rewritten rows
+} replace_job;
+
+// rewrite every match in row from column x on into a new buffer in a single
+// pass, leaving the old chars to the caller in *old (copied out if they were
+// held in the row itself or a cold block), and return number of matches
+// replaced
+// cold rows are read through a buffer shared with the editor, so only on
+// its thread
+llong_t replace_in_row(textrow *row, llong_t x, replace_job *job,
+                       char **old) {
+  // collect matches and the length of the rewritten row
+  const char *from = peek_chars(row);
+  llong_t n = 0, newlen = row->len, off = x;
+  while (off < row->len) {
+    ullong_t mlen;
+    const char *m = search_mem(&from[off], row->len - off, E.query, E.qlen,
+                               E.sflags, &mlen);
+    if (!m)
+      break;
+    if (n == job->cap) {
+      job->cap = job->cap ? job->cap * 2 : 16;
+      job->matches = realloc(job->matches, sizeof(llong_t) * 2 * job->cap);
+      if (!job->matches)
+        die("realloc");
+    }
+    job->matches[2 * n] = m - from;
+    job->matches[2 * n + 1] = off = m - from + mlen;
+    newlen += job->wlen - (llong_t)mlen;
+    n++;
+  }
+  if (!n)
+    return 0;
+
+  check_row_len(newlen);
+  char *chars = malloc(newlen + 1);
+  if (!chars)
+    die("malloc");
+  llong_t src = 0, dst = 0;
+  for (llong_t i = 0; i < n; i++) {
+    llong_t start = job->matches[2 * i], end = job->matches[2 * i + 1];
+    memcpy(&chars[dst], &from[src], start - src);
+    dst += start - src;
+    memcpy(&chars[dst], job->with, job->wlen);
+    dst += job->wlen;
+    src = end;
+  }
+  memcpy(&chars[dst], &from[src], row->len - src + 1);
+
+  *old = (char *)from;
+  if ((row->flags & (ROW_LOCAL | ROW_COLD)) && !(*old = malloc(row->len + 1)))
+    die("malloc");
+  if (*old != from)
+    memcpy(*old, from, row->len + 1);
+  if (row->flags & ROW_COLD)
+    release_block(row->data.cold.block, row_shared(row));
+  drop_render(row);
+  row_adopt(row, chars, newlen);
+  render_row(row);
+  return n;
+}
+
+// replace all matches in a range of rows
+// runs on worker threads, so leaves generations and the index to the caller
+void *replace_rows(void *arg) {
+  replace_job *job = arg;
+  cur = job->ed;
+  for (llong_t i = job->from; i < job->to; i++) {
+    char *old;
+    llong_t oldlen = E.rows[i].len;
+    int inarena = (E.rows[i].flags & ROW_ARENA) != 0;
+    llong_t x = i == job->from ? job->x : 0;
+    llong_t n = replace_in_row(&E.rows[i], x, job, &old);
+    if (!n)
+      continue;
+    job->count += n;
+    if (!(job->nchanged & (job->nchanged - 1))) {
+      llong_t cap = job->nchanged ? job->nchanged * 2 : 1;
+      job->changed = realloc(job->changed, sizeof(llong_t) * cap);
+      job->old = realloc(job->old, sizeof(char *) * cap);
+      job->oldlen = realloc(job->oldlen, sizeof(llong_t) * cap);
+      job->inarena = realloc(job->inarena, cap);
+      if (!job->changed || !job->old || !job->oldlen || !job->inarena)
+        die("realloc");
+    }
+    job->changed[job->nchanged] = i;
+    job->inarena[job->nchanged] = inarena;
+    job->old[job->nchanged] = old;
+    job->oldlen[job->nchanged++] = oldlen;
+  }
+  return NULL;
+}
+
+// replace every match of the current query from row y, column x onwards with
+// s, splitting rows between threads on large buffers, and return the number
+// of matches replaced
+llong_t replace_all(const char *with, llong_t y, llong_t x) {
+  llong_t start = now_us();
+  llong_t nrows = E.nrows - y;
+  long nthreads = sysconf(_SC_NPROCESSORS_ONLN);
+  if (nthreads > nrows / TIN_REPLACE_THREAD_ROWS)
+    nthreads = nrows / TIN_REPLACE_THREAD_ROWS;
+  if (nthreads > TIN_REPLACE_MAX_THREADS)
+    nthreads = TIN_REPLACE_MAX_THREADS;
+  if (nthreads < 1 || E.cold)
+    nthreads = 1; // cold rows are unpacked into one shared buffer
+
+  replace_job jobs[TIN_REPLACE_MAX_THREADS];
+  pthread_t threads[TIN_REPLACE_MAX_THREADS];
+  memset(jobs, 0, sizeof(jobs));
+  for (long t = 0; t < nthreads; t++) {
+    jobs[t].ed = cur;
+    jobs[t].from = y + nrows * t / nthreads;
+    jobs[t].to = y + nrows * (t + 1) / nthreads;
+    jobs[t].x = t ? 0 : x;
+    jobs[t].with = with;
+    jobs[t].wlen = strlen(with);
+  }
+
+  // run the first job here, any others on their own threads
+  long started = 1;
+  while (started < nthreads &&
+         !pthread_create(&threads[started], NULL, replace_rows, &jobs[started]))
+    started++;
+  for (long t = started; t < nthreads; t++)
+    replace_rows(&jobs[t]);
+  replace_rows(&jobs[0]);
+
+  // record each rewritten row as a single undo step
+  llong_t count = 0;
+  undo_begin(&E.undo);
+  for (long t = 0; t < nthreads; t++) {
+    if (t && t < started)
+      pthread_join(threads[t], NULL);
+    for (llong_t i = 0; i < jobs[t].nchanged; i++) {
+      llong_t y = jobs[t].changed[i];
+      textrow *row = &E.rows[y];
+      record_edit(UNDO_DELETE, y, 0, jobs[t].old[i], jobs[t].oldlen[i]);
+      record_edit(UNDO_INSERT, y, 0, row_chars(row), row->len);
+      if (!jobs[t].inarena[i])
+        release_chars(jobs[t].old[i], row_shared(row));
+      touch_row(row);
+    }
+    count += jobs[t].count;
+    free(jobs[t].matches);
+    free(jobs[t].changed);
+    free(jobs[t].old);
+    free(jobs[t].oldlen);
+    free(jobs[t].inarena);
+  }
+  undo_end(&E.undo);
+  E.dirty += count;
+  trace("replace", start, "\"count\":%lld,\"threads\":%ld", count, nthreads);
+  return count;
+}
+
+// return nonzero and set *y, *x and *mlen to the next match of the current
+// query in raw chars at or after row y, column x
+int next_match(llong_t *y, llong_t *x, llong_t *mlen) {
+  for (; *y < E.nrows; (*y)++, *x = 0) {
+    textrow *row = &E.rows[*y];
+    if (*x > row->len)
+      continue;
+    ullong_t len;
+    const char *chars = peek_chars(row);
+    const char *m = search_mem(&chars[*x], row->len - *x, E.query, E.qlen,
+                               E.sflags, &len);
+    if (m) {
+      *x = m - chars;
+      *mlen = len;
+      return 1;
+    }
+  }
+  return 0;
+}
+
+void replace() {
+  own_rows();
+  llong_t orig_cx = E.cx, orig_cy = E.cy;
+  llong_t orig_coloff = E.coloff, orig_rowoff = E.rowoff;
+
+  char *query = prompt(find_prompt("replace"), find_callback);
+  char *with = (query && query[0]) ? prompt("replace with: %s", NULL) : NULL;
+  if (!with) {
+    E.cx = orig_cx;
+    E.cy = orig_cy;
+    E.coloff = orig_coloff;
+    E.rowoff = orig_rowoff;
+    set_query(NULL);
+    set_status_msg("replace aborted");
+    free(query);
+    return;
+  }
+  set_query(query);
+
+  // confirm each match from the cursor onwards, or replace all at once
+  llong_t count = 0, wlen = strlen(with), y = E.cy, x = E.cx, mlen;
+  while (next_match(&y, &x, &mlen)) {
+    E.cy = y;
+    E.cx = x;
+    set_status_msg("replace? (y)es (n)o (a)ll the rest, ESC to stop");
+    refresh_screen();
+
+    int c = read_answer();
+    if (c == 'a') {
+      count += replace_all(with, y, x); // the rest, not those declined
+      break;
+    } else if (c == 'y') {
+      undo_begin(&E.undo);
+      record_edit(UNDO_DELETE, y, x, &row_chars(&E.rows[y])[x], mlen);
+      record_edit(UNDO_INSERT, y, x, with, wlen);
+      undo_end(&E.undo);
+      row_splice(&E.rows[y], x, mlen, with, wlen);
+      x += wlen;
+      count++;
+    } else if (c == 'n') {
+      x += mlen ? mlen : 1;
+    } else if (c == ESC) {
+      break;
+    }
+  }
+
+  if (E.cy < E.nrows && E.cx > E.rows[E.cy].len)
+    E.cx = E.rows[E.cy].len;
+  set_query(NULL);
+  set_status_msg("replaced %lld %s", count, count == 1 ? "match" : "matches");
+  free(query);
+  free(with);
+}
+
+/* autosave */
+
+// write a snapshot of the rows to the autosave file
+// runs on a worker thread, so only reads the snapshot's rows
+void *autosave_rows(void *arg) {
+  snapshot *snap = arg;
+  llong_t written;
+  const char *what = NULL;
+  int err = 0;
+  if (save_rows(snap->path, snap->rows, snap->nrows, snap->src, &snap->stamp,
+                snap->sync, &written, &what) == -1)
+    err = errno;
+
+  pthread_mutex_lock(&snap->lock);
+  snap->done = 1;
+  snap->err = err;
+  snap->what = what;
+  pthread_mutex_unlock(&snap->lock);
+  return NULL;
+}
+
+// wait for the autosave worker and free what the editor dropped meanwhile
+void autosave_finish() {
+  if (!E.snap.active)
+    return;
+  pthread_join(E.snap.thread, NULL);
+  if (E.snap.err) {
+    set_status_msg("autosave %s: %s", E.snap.what, strerror(E.snap.err));
+  }
+  for (llong_t i = 0; i < E.snap.ngarbage; i++)
+    free(E.snap.garbage[i]);
+  E.snap.ngarbage = 0;
+  if (E.snap.rows != E.rows)
+    free(E.snap.rows);
+  free(E.snap.path);
+  free(E.snap.src);
+  E.snap.rows = NULL;
+  E.snap.path = NULL;
+  E.snap.src = NULL;
+  E.snap.active = 0;
+}
+
+// finish an autosave once its worker is done, and start a new one if the
+// buffer changed and enough time has passed
+// a new one only starts between keys in the main loop, when no pointers
+// into E.rows are held
+void autosave_tick() {
+  if (E.snap.active) {
+    pthread_mutex_lock(&E.snap.lock);
+    int done = E.snap.done;
+    pthread_mutex_unlock(&E.snap.lock);
+    if (!done)
+      return;
+    autosave_finish();
+  }
+
+  if (!E.autosave_secs || !E.waiting || !E.filename || !E.nrows)
+    return;
+  if (!E.dirty || E.dirty == E.autosave_dirty)
+    return;
+  if (time(NULL) - E.autosave_time < E.autosave_secs)
+    return;
+
+  // taking the snapshot is O(1): edits copy rows and chars as needed
+  E.snap.path = sidecar_path(E.filename, "tin-autosave");
+  E.snap.src = strdup(E.filename);
+  if (!E.snap.path || !E.snap.src) {
+    free(E.snap.path);
+    free(E.snap.src);
+    E.snap.path = E.snap.src = NULL;
+    return;
+  }
+  E.snap.stamp = E.stamp;
+  E.snap.sync = E.sync;
+  E.snap.rows = E.rows;
+  E.snap.nrows = E.nrows;
+  E.snap.gen = E.gen;
+  E.snap.done = E.snap.err = 0;
+  E.snap.active = 1;
+  if (pthread_create(&E.snap.thread, NULL, autosave_rows, &E.snap) != 0) {
+    free(E.snap.path);
+    free(E.snap.src);
+    E.snap.path = E.snap.src = NULL;
+    E.snap.active = 0;
+    return;
+  }
+  E.autosave_time = time(NULL);
+  E.autosave_dirty = E.dirty;
+}
+
+// remove the autosave file, e.g. once the buffer has been saved
+void remove_autosave() {
+  if (!E.autosave_secs || !E.filename)
+    return;
+  autosave_finish();
+  char *path = sidecar_path(E.filename, "tin-autosave");
+  if (path)
+    unlink(path);
+  free(path);
+}
+
+/* crash recovery */
+
+// reapply an edit read back from the journal
+// return 0, or -1 without applying it if it does not fit the rows, as when
+// the journal is torn or was written against other text
+int replay_edit(int kind, llong_t y, llong_t x, const char *s, ullong_t len) {
+  if ((kind != UNDO_INSERT && kind != UNDO_DELETE) || y < 0 || y > E.nrows ||
+      x < 0 || x > (y < E.nrows ? E.rows[y].len : 0) || (llong_t)len < 0)
+    return -1;
+  if (kind == UNDO_INSERT) {
+    insert_text(y, x, s, len);
+    return 0;
+  }
+
+  // a deletion must end within the buffer, each newline counting one byte
+  llong_t left = (llong_t)len;
+  for (llong_t ey = y; left > 0; ey++) {
+    if (ey == E.nrows)
+      return -1;
+    left -= (ey == y ? E.rows[ey].len - x : E.rows[ey].len + 1);
+  }
+  delete_text(y, x, len);
+  return 0;
+}
+
+// start journaling edits to the open file, first offering to recover edits
+// left in the journal by a previous session if check is set
+void start_journal(int check) {
+  if (!E.filename)
+    return;
+  char *path = sidecar_path(E.filename, "tin-journal");
+  if (!path)
+    return;
+
+  filestamp st;
+  if (stamp_file(E.filename, &st) == -1) {
+    st.size = 0;
+    st.mtime_ns = 0;
+  }
+
+  int keep = 0;
+  if (check && journal_has_edits(path)) {
+    set_status_msg("recover unsaved changes from journal? (y/n)");
+    refresh_screen();
+    if (read_answer() == 'y') {
+      llong_t n = journal_replay(path, st.size, st.mtime_ns, replay_edit);
+      if (n == -1)
+        set_status_msg("journal does not match file, not recovered");
+      else
+        set_status_msg("recovered %lld %s", n, n == 1 ? "edit" : "edits");
+      keep = (n != -1);
+    } else {
+      set_status_msg("");
+    }
+  }
+
+  if (journal_open(&E.journal, path, st.size, st.mtime_ns, keep) == -1)
+    REPORT_ERR("journal error");
+  free(path);
+}
+
 /* file i/o */
 
 int open_file(char *fname) {
@@ -819,126 +2299,804 @@ int open_file(char *fname) {
   FILE *fp = fopen(E.filename, "r");
   if (!fp)
     return -1;
+  stamp_file(E.filename, &E.stamp);
+  E.tail_dev = E.stamp.dev;
+  E.tail_ino = E.stamp.ino;
 
   char *line = NULL;
   ullong_t size = 0;
   llong_t len = 0;
+  llong_t off = 0;
+  llong_t start = now_us();
+
+  // files too big to keep whole in memory load straight into cold blocks
+  abuf pending;
+  ab_init(&pending);
+  llong_t packed = E.nrows; // rows before this are packed
+  E.cold = E.stamp.size >= TIN_COLD_FILE;
 
   // read lines until EOF
   while ((len = getline(&line, (unsigned long *)&size, fp)) != -1) {
+    llong_t raw = len;
     while (len > 0 && (line[len - 1] == '\n' || line[len - 1] == '\r'))
       len--;
-    insert_row(E.nrows, line, len);
+    if (len > ROW_MAX_LEN) {
+      // too long to edit, so leave the file to be paged instead
+      if (E.cold)
+        pack_rows(packed, E.nrows, &pending);
+      del_rows(0, E.nrows);
+      arena_free(&E.arena);
+      intern_free(&E.interns);
+      ab_free(&pending);
+      free(line);
+      fclose(fp);
+      E.dirty = 0;
+      E.cold = 0;
+      errno = EFBIG;
+      return -1;
+    }
+
+    // rows saved back verbatim can later be copied from the file
+    int verbatim = raw == len || (raw == len + 1 && line[len] == '\n');
+    insert_rows(E.nrows, 1);
+    textrow *row = &E.rows[E.nrows - 1];
+    if (!E.cold) {
+      load_row(row, line, len, verbatim ? off : -1);
+    } else {
+      load_cold_row(row, &pending, line, len, verbatim ? off : -1);
+      if (pending.len >= TIN_COLD_BLOCK) {
+        pack_rows(packed, E.nrows, &pending);
+        packed = E.nrows;
+      }
+    }
+    off += raw;
+    E.tail_open = line[raw - 1] != '\n';
   }
+  E.tail = off;
+  if (E.cold)
+    pack_rows(packed, E.nrows, &pending);
+  ab_free(&pending);
 
   free(line);
   fclose(fp);
   E.dirty = 0;
+  trace("load", start, "\"rows\":%lld,\"bytes\":%lld,\"cold\":%d", E.nrows,
+        off, E.cold);
   return 0;
 }
 
 void write_file() {
-  struct stat st;
-  mode_t fmode = S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH; // 0644
-  uid_t uid = getuid();
-  gid_t gid = getgid();
-  int islink = 0;
-
   if (E.filename == NULL) {
     E.filename = prompt("save as: %s", NULL);
+    if (E.filename && !E.filename[0]) {
+      free(E.filename);
+      E.filename = NULL;
+    }
     if (E.filename == NULL) {
       set_status_msg("write aborted");
       return;
     }
-  } else {
-    if (lstat(E.filename, &st) == -1) {
-      REPORT_ERR("stat error");
-    } else {
-      fmode = st.st_mode;
-      uid = st.st_uid;
-      gid = st.st_gid;
-      islink = S_ISLNK(st.st_mode);
-    }
   }
 
-  // create tmp file to write everything to
-  char *tmpname = strdup(E.filename);
-  tmpname = strcat(tmpname, ".XXXXXX");
-  int fd = mkstemp(tmpname);
-  if (fd == -1) {
-    REPORT_ERR("write error");
+  llong_t written;
+  const char *err;
+  llong_t start = now_us();
+  int saved = save_rows(E.filename, E.rows, E.nrows, E.filename, &E.stamp,
+                        E.sync, &written, &err);
+  if (saved == -1) {
+    set_status_msg("%s: %s", err, strerror(errno));
+    trace("save", start, "\"error\":%d", errno);
     return;
   }
+  double ms = (now_us() - start) / 1e3;
+  trace("save", start, "\"bytes\":%lld,\"sync\":\"%s\"", written,
+        sync_names[E.sync]);
+  if (saved == 1) // written, but the rename may not survive a crash
+    set_status_msg("wrote %lld bytes, but %s: %s", written, err,
+                   strerror(errno));
+  else
+    set_status_msg("wrote %lld bytes in %.1f ms (sync %s)", written, ms,
+                   sync_names[E.sync]);
+  E.dirty = 0;
 
-  // write lines to tmp file
+  // every row now sits unedited in the file just written
+  own_rows();
+  llong_t off = 0;
   for (llong_t i = 0; i < E.nrows; i++) {
-    llong_t len = E.rows[i].len;
-    if (write(fd, E.rows[i].chars, len) != len) {
-      REPORT_ERR("write error");
-      close(fd);
+    E.rows[i].orig = off;
+    off += E.rows[i].len + 1;
+  }
+  stamp_file(E.filename, &E.stamp);
+
+  // appends now land after what was just written, which ends mid-line
+  E.tail = written;
+  E.tail_open = E.nrows > 0;
+  E.tail_dev = E.stamp.dev;
+  E.tail_ino = E.stamp.ino;
+  if (E.watch.fd != -1)
+    watch_path(&E.watch, E.filename);
+
+  // saved edits no longer need recovering
+  filestamp now;
+  if (stamp_file(E.filename, &now) == -1)
+    REPORT_ERR("stat error");
+  else if (E.journal.fd == -1)
+    start_journal(0);
+  else
+    journal_reset(&E.journal, now.size, now.mtime_ns);
+  remove_autosave();
+}
+
+void quit(int tries_left) {
+  if (E.dirty && tries_left) {
+    char *fmt = "UNSAVED CHANGES! (^X %d more %s to quit)";
+    char *noun = (tries_left == 1) ? "time" : "times";
+    set_status_msg(fmt, tries_left, noun);
+    return;
+  }
+  journal_close(&E.journal, 1);
+  remove_autosave();
+  trace_close(&E.trace);
+  clear_tty();
+  E.quit = 1;
+}
+
+/* follow */
+
+// append the lines in len bytes of buf, read from offset off of the file
+// (or -1 if not read from a file), continuing the last row if the file's last
+// line was still open
+void follow_append(const char *buf, llong_t len, llong_t off) {
+  const char *at = buf, *end = buf + len, *nl;
+  if (E.tail_open && E.nrows) {
+    nl = memchr(at, '\n', end - at);
+    llong_t seg = (nl ? nl : end) - at;
+    while (nl && seg > 0 && at[seg - 1] == '\r')
+      seg--;
+    textrow *row = &E.rows[E.nrows - 1];
+    row_strcat(row, (char *)at, seg);
+    if (!nl)
       return;
+    // the \r of a \r\n may have come with the start of the line
+    llong_t len = row->len;
+    while (!seg && len > 0 && peek_chars(row)[len - 1] == '\r')
+      len--;
+    if (len < row->len)
+      row_splice(row, len, row->len - len, "", 0);
+    at = nl + 1;
+    E.tail_open = 0;
+  }
+  if (at == end)
+    return;
+
+  // make room for every new line at once
+  llong_t n = 0;
+  for (const char *p = at; (nl = memchr(p, '\n', end - p)); p = nl + 1)
+    n++;
+  E.tail_open = end[-1] != '\n';
+  llong_t y = E.nrows;
+  insert_rows(y, n + E.tail_open);
+
+  while (at < end) {
+    nl = memchr(at, '\n', end - at);
+    llong_t raw = (nl ? nl + 1 : end) - at, seg = (nl ? nl : end) - at;
+    while (nl && seg > 0 && at[seg - 1] == '\r')
+      seg--;
+    int verbatim = off >= 0 && (raw == seg || (raw == seg + 1 && nl));
+    load_row(&E.rows[y], at, seg, verbatim ? off + (at - buf) : -1);
+    y++;
+    at += raw;
+  }
+}
+
+// read what was appended to the followed file (or piped in) since it was
+// last read, keeping the cursor on the last row if it was there
+// return whether any rows changed
+int follow_read() {
+  llong_t nrows = E.nrows, tail = E.tail;
+  int pinned = E.cy >= E.nrows - 1;
+
+  if (E.stream.fd != -1) {
+    abuf in;
+    int eof = stream_take(&E.stream, &in);
+    if (in.len) {
+      ullong_t dirty = E.dirty;
+      own_rows();
+      follow_append(in.buf, in.len, -1);
+      E.tail += in.len;
+      E.dirty = dirty;
     }
-    if (i < E.nrows - 1 && write(fd, "\n", 1) != 1) {
-      REPORT_ERR("write error");
-      close(fd);
-      return;
+    ab_free(&in);
+    if (eof) {
+      if (E.stream.err)
+        set_status_msg("read error: %s", strerror(E.stream.err));
+      stream_close(&E.stream);
+      E.follow = 0; // nothing more will come
     }
+  } else if (paging()) {
+    E.pager.done = 0; // count lines past the old end too
+    page_to(E.nrows);
+  } else {
+    int fd = open(E.filename, O_RDONLY);
+    struct stat st;
+    if (fd == -1 || fstat(fd, &st) == -1) {
+      if (fd != -1)
+        close(fd);
+      return 0;
+    }
+
+    // carry on from the start of a file that was replaced or truncated
+    if (st.st_dev != E.tail_dev || st.st_ino != E.tail_ino ||
+        st.st_size < E.tail) {
+      set_status_msg("%s was %s", E.filename,
+                     st.st_ino != E.tail_ino ? "replaced" : "truncated");
+      E.tail = E.tail_open = 0;
+      E.tail_dev = st.st_dev;
+      E.tail_ino = st.st_ino;
+      E.stamp.size = -1; // rows no longer match what is on disk
+      watch_path(&E.watch, E.filename);
+    }
+
+    // appended rows are the file's, not edits, so leave the buffer clean
+    ullong_t dirty = E.dirty;
+    int clean = E.tail == E.stamp.size;
+    char *buf = E.tail < st.st_size ? malloc(TIN_FOLLOW_CHUNK) : NULL;
+    llong_t stop = E.tail + TIN_FOLLOW_FRAME;
+    if (buf)
+      own_rows();
+    while (buf && E.tail < st.st_size && E.tail < stop) {
+      llong_t n = pread(fd, buf, TIN_FOLLOW_CHUNK, E.tail);
+      if (n == -1 && errno == EINTR)
+        continue;
+      if (n <= 0)
+        break;
+      follow_append(buf, n, E.tail);
+      E.tail += n;
+    }
+    E.file_due = E.tail < st.st_size; // read the rest next frame
+    E.dirty = dirty;
+    free(buf);
+    close(fd);
+
+    // the rows still match the file if they did before the append, and
+    // unsaved edits still apply to it, since the new rows come after them
+    if (clean)
+      stamp_file(E.filename, &E.stamp);
+    if (clean && !E.dirty && E.journal.fd != -1)
+      journal_reset(&E.journal, E.stamp.size, E.stamp.mtime_ns);
+    else if (clean && E.journal.fd != -1)
+      journal_restamp(&E.journal, E.stamp.size, E.stamp.mtime_ns);
   }
 
-  // expand target path if symlink
-  char real[PATH_MAX + 1];
-  if (islink) {
-    llong_t len = readlink(E.filename, real, PATH_MAX);
-    if (len == -1) {
-      REPORT_ERR("readlink error");
-      close(fd);
-      return;
+  if (pinned && E.nrows > nrows) {
+    E.cy = E.nrows - 1;
+    llong_t len = get_row(E.cy)->len;
+    if (E.cx > len)
+      E.cx = len;
+  }
+  return E.nrows != nrows || E.tail != tail;
+}
+
+// wait up to TIN_FOLLOW_POLL_MS for a key, reading what is appended to a
+// followed file or resyncing a watched one meanwhile, at most once per frame
+// return 1 if a key is ready, 0 if not, or -1 if the screen needs redrawing
+// input that cannot be polled is taken to always be ready
+int wait_key() {
+  if ((!E.follow && E.watch.fd == -1) || E.io.fd == -1)
+    return 1;
+
+  int piped = E.stream.fd != -1;
+  int fd = piped ? E.stream.wake[0] : E.watch.fd;
+  struct pollfd fds[2] = {{E.io.fd, POLLIN, 0}, {fd, POLLIN, 0}};
+
+  // appends are read once per frame, but a resync waits for writes to the
+  // file to stop rather than catch it e.g. truncated and half rewritten
+  llong_t due = E.drawn_ms + TIN_FRAME_MS;
+  if (!E.follow && due < E.changed_ms + TIN_RESYNC_QUIET_MS)
+    due = E.changed_ms + TIN_RESYNC_QUIET_MS;
+  llong_t timeout = TIN_FOLLOW_POLL_MS;
+  if (E.file_due)
+    timeout = due > now_ms() ? due - now_ms() : 0;
+
+  // the wake pipe is only drained when the data is taken, so stop polling it
+  // once that is due or it would stay readable and spin until then
+  int nfds = fd == -1 || (piped && E.file_due) ? 1 : 2;
+  int n = poll(fds, nfds, timeout);
+  if (n > 0 && (fds[0].revents & POLLIN))
+    return 1;
+  if (n > 0 && (fds[1].revents & POLLIN) && (piped || watch_read(&E.watch))) {
+    E.file_due = 1;
+    E.changed_ms = now_ms();
+    return 0; // wait again, until the change is due
+  }
+  if (n == 0 && !piped && E.watch.wd == -1)
+    E.file_due = 1; // no inotify, so check the file every so often
+
+  if (E.file_due && now_ms() >= due) {
+    E.file_due = 0;
+    if (!piped && E.watch.wd == -1)
+      watch_path(&E.watch, E.filename); // e.g. the file now exists
+    llong_t start = now_us();
+    int changed = E.follow ? follow_read() : resync_file();
+    trace(E.follow ? "follow" : "resync", start, "\"rows\":%lld", E.nrows);
+    if (changed)
+      return -1;
+  }
+  return 0;
+}
+
+/* resync */
+
+// a line of a file being resynced
+typedef struct fileline {
+  const char *s; // chars, without the line ending
+  llong_t len;   // number of chars
+  ullong_t hash; // hash of the chars
+} fileline;
+
+// a row the same in the buffer and the file, around which the rest is synced
+typedef struct anchor {
+  llong_t y;    // row in the buffer
+  llong_t line; // line in the file
+} anchor;
+
+// return whether row holds exactly the len chars at s
+int row_equals(textrow *row, const char *s, llong_t len) {
+  return row->len == len && !memcmp(peek_chars(row), s, len);
+}
+
+// return the length of the line at s without its line ending
+llong_t line_len(const char *s, const char *end) {
+  const char *nl = memchr(s, '\n', end - s);
+  llong_t len = (nl ? nl : end) - s;
+  while (len > 0 && s[len - 1] == '\r')
+    len--;
+  return len;
+}
+
+// make the n rows at at hold the m lines in lines, changing rows in place
+// while both have one and inserting or deleting the rest
+// return the number of rows changed, inserted or deleted
+llong_t resync_rows(llong_t at, llong_t n, fileline *lines, llong_t m) {
+  llong_t k = n < m ? n : m, changed = 0;
+  for (llong_t t = 0; t < k; t++) {
+    textrow *row = &E.rows[at + t];
+    if (!row_equals(row, lines[t].s, lines[t].len)) {
+      row_splice(row, 0, row->len, lines[t].s, lines[t].len);
+      changed++;
     }
-    real[len] = '\0';
-  } else {
-    strcpy(real, E.filename);
   }
+  // inserted rows get their own buffers, since arena bytes are only freed
+  // with the editor and a file rewritten over and over would grow it
+  if (m > n) {
+    insert_rows(at + k, m - k);
+    for (llong_t t = k; t < m; t++)
+      init_row(&E.rows[at + t], lines[t].s, lines[t].len);
+  } else if (n > m) {
+    del_rows(at + k, n - k);
+  }
+  return changed + (m > n ? m - n : n - m);
+}
 
-  // rename tmp to target
-  if (rename(tmpname, real) == -1) {
-    REPORT_ERR("save error");
-    close(fd);
-    return;
+// return where row y of n rows ends up once they are resynced with m lines
+// around the anchors in a
+llong_t resync_map(llong_t y, anchor *a, llong_t na, llong_t m) {
+  llong_t lo = 0, hi = na; // first anchor at or after y
+  while (lo < hi) {
+    llong_t mid = (lo + hi) / 2;
+    if (a[mid].y < y)
+      lo = mid + 1;
+    else
+      hi = mid;
   }
+  if (lo < na && a[lo].y == y)
+    return a[lo].line;
 
-  // set file permissions
-  if (fchmod(fd, fmode) == -1)
-    REPORT_ERR("stat error");
-  if (fchown(fd, uid, gid) == -1)
-    REPORT_ERR("stat error");
+  // keep the offset into the gap, within what the gap becomes
+  llong_t y0 = lo ? a[lo - 1].y + 1 : 0, l0 = lo ? a[lo - 1].line + 1 : 0;
+  llong_t gap = (lo < na ? a[lo].line : m) - l0;
+  return l0 + (y - y0 < gap ? y - y0 : (gap ? gap - 1 : 0));
+}
 
-  // stat again to get final filesize
-  if (stat(E.filename, &st) == -1)
-    REPORT_ERR("stat error");
-  set_status_msg("wrote %lld bytes", st.st_size);
+// pick rows of the buffer's [p, oe) that are unique there and also appear in
+// the file's lines, in order, as anchors
+// return the number of anchors stored in *out, which must be freed
+llong_t resync_anchors(llong_t p, llong_t oe, fileline *lines, llong_t n,
+                       anchor **out) {
+  // open addressing table of row hashes, with how often each appears
+  llong_t cap = 16;
+  while (cap < 2 * (oe - p))
+    cap *= 2;
+  struct slot {
+    ullong_t hash;
+    llong_t y, count;
+  } *slots = calloc(cap, sizeof(*slots));
+  anchor *a = malloc(sizeof(anchor) * (n + 1));
+  if (!slots || !a)
+    die("malloc");
+
+  for (llong_t y = p; y < oe; y++) {
+    ullong_t h = hash_bytes(peek_chars(&E.rows[y]), E.rows[y].len);
+    llong_t i = h & (cap - 1);
+    while (slots[i].count && slots[i].hash != h)
+      i = (i + 1) & (cap - 1);
+    slots[i].hash = h;
+    slots[i].y = y;
+    slots[i].count++;
+  }
+
+  llong_t na = 0, last = p - 1;
+  for (llong_t l = 0; l < n; l++) {
+    llong_t i = lines[l].hash & (cap - 1);
+    while (slots[i].count && slots[i].hash != lines[l].hash)
+      i = (i + 1) & (cap - 1);
+    llong_t y = slots[i].y;
+    if (slots[i].count == 1 && y > last &&
+        row_equals(&E.rows[y], lines[l].s, lines[l].len)) {
+      a[na].y = y;
+      a[na++].line = p + l;
+      last = y;
+    }
+  }
+  free(slots);
+  *out = a;
+  return na;
+}
+
+// a window of up to TIN_FOLLOW_CHUNK bytes of a file being resynced
+typedef struct filewin {
+  int fd;      // the file
+  char *buf;   // bytes of the window
+  llong_t off; // offset of the window in the file
+  llong_t len; // bytes in the window
+} filewin;
+
+// fill w with the bytes of [from, to) of its file, or as many as fit of those
+// at the end if back is set, or else the start
+// return 0, or -1 if they could not all be read
+int win_read(filewin *w, llong_t from, llong_t to, int back) {
+  if (to - from > TIN_FOLLOW_CHUNK) {
+    if (back)
+      from = to - TIN_FOLLOW_CHUNK;
+    else
+      to = from + TIN_FOLLOW_CHUNK;
+  }
+  w->off = from;
+  w->len = 0;
+  while (w->len < to - from) {
+    llong_t n =
+        pread(w->fd, &w->buf[w->len], to - from - w->len, from + w->len);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      return -1;
+    w->len += n;
+  }
+  return 0;
+}
+
+// bring the rows in line with the file after it changed on disk, replacing
+// only rows that differ and keeping the cursor and view on the same text
+// the unchanged lines at the top and bottom are compared a window at a time,
+// and only the lines between them are read in full, which for a file only
+// appended to are the new lines
+// a buffer with unsaved edits is left alone
+// return whether the screen needs redrawing
+int resync_file() {
+  filestamp now;
+  if (!E.filename || stamp_file(E.filename, &now) == -1 ||
+      (stamp_equal(&now, &E.stamp) && E.tail == now.size))
+    return 0;
+  if (now.ino != E.stamp.ino || now.dev != E.stamp.dev)
+    watch_path(&E.watch, E.filename); // e.g. replaced by a rename
+  if (E.dirty) {
+    set_status_msg("%.40s changed on disk", E.filename);
+    return 1;
+  }
+
+  int fd = open(E.filename, O_RDONLY);
+  if (fd == -1)
+    return 0;
+  filewin w = {fd, malloc(TIN_FOLLOW_CHUNK), 0, 0};
+  if (!w.buf)
+    die("malloc");
+
+  // skip the lines at the top that are unchanged, noting where they are
+  own_rows();
+  llong_t p = 0, top = 0; // rows the same, and where the line after starts
+  w.off = w.len = 0;
+  while (p < E.nrows && top < now.size) {
+    char *at = &w.buf[top - w.off], *end = &w.buf[w.len];
+    char *nl = top < w.off + w.len ? memchr(at, '\n', end - at) : NULL;
+    if (!nl && w.off + w.len < now.size) {
+      if (top == w.off && w.len)
+        break; // too long for a window, so taken as changed
+      if (win_read(&w, top, now.size, 0) == -1)
+        goto fail;
+      continue;
+    }
+    llong_t len = line_len(at, end);
+    if (!row_equals(&E.rows[p], at, len))
+      break;
+    E.rows[p].orig = (nl ? nl : end) - at == len ? top : -1;
+    top += (nl ? nl + 1 : end) - at;
+    p++;
+  }
+
+  // and those at the bottom, stepping back through the file
+  llong_t s = 0, bottom = now.size; // rows the same, and where they start
+  while (s < E.nrows - p && bottom > top) {
+    if (bottom <= w.off || bottom > w.off + w.len) {
+      if (win_read(&w, top, bottom, 1) == -1)
+        goto fail;
+    }
+    char *back = &w.buf[bottom - w.off];
+    char *lo = top > w.off ? &w.buf[top - w.off] : w.buf;
+    // step back over the newline ending the line, if it has one
+    char *start = (bottom == now.size && back[-1] != '\n') ? back : back - 1;
+    while (start > lo && start[-1] != '\n')
+      start--;
+    if (start == lo && w.off > top) {
+      if (w.off + w.len == bottom)
+        break; // too long for a window, so taken as changed
+      w.len = 0; // read a window ending at bottom
+      continue;
+    }
+    llong_t len = line_len(start, back);
+    textrow *row = &E.rows[E.nrows - 1 - s];
+    if (!row_equals(row, start, len))
+      break;
+    const char *nl = memchr(start, '\n', back - start);
+    bottom = w.off + (start - w.buf);
+    row->orig = (nl ? nl : back) - start == len ? bottom : -1;
+    s++;
+  }
+  char last = '\n'; // last byte of the file
+  if (now.size && pread(fd, &last, 1, now.size - 1) != 1)
+    goto fail;
+
+  // read the lines in between in full
+  llong_t size = bottom - top;
+  free(w.buf);
+  if (!(w.buf = malloc(size + 1)))
+    die("malloc");
+  for (w.len = 0; w.len < size;) {
+    llong_t n = pread(fd, &w.buf[w.len], size - w.len, top + w.len);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n <= 0)
+      goto fail;
+    w.len += n;
+  }
   close(fd);
+  const char *buf = w.buf, *end = buf + size, *at = buf;
+
+  // hash them
+  llong_t oe = E.nrows - s, n = 0;
+  for (const char *q = buf; q < end; n++) {
+    const char *nl = memchr(q, '\n', end - q);
+    q = nl ? nl + 1 : end;
+  }
+  fileline *lines = malloc(sizeof(fileline) * (n ? n : 1));
+  if (!lines)
+    die("malloc");
+  for (llong_t l = 0; l < n; l++) {
+    lines[l].s = at;
+    lines[l].len = line_len(at, end);
+    lines[l].hash = hash_bytes(at, lines[l].len);
+    const char *nl = memchr(at, '\n', end - at);
+    at = nl ? nl + 1 : end;
+  }
+
+  // resync the gaps between anchors from the bottom up, so that rows above
+  // keep their place, after working out where the cursor and view go
+  anchor *a;
+  llong_t na = resync_anchors(p, oe, lines, n, &a);
+  for (llong_t i = 0; i < na; i++) {
+    a[i].y -= p;
+    a[i].line -= p;
+  }
+  llong_t *ys[] = {&E.cy, &E.rowoff};
+  for (int i = 0; i < 2; i++) {
+    if (*ys[i] >= oe)
+      *ys[i] += p + n - oe;
+    else if (*ys[i] >= p)
+      *ys[i] = p + resync_map(*ys[i] - p, a, na, n);
+  }
+
+  llong_t changed = 0;
+  for (llong_t i = na; i >= 0; i--) {
+    llong_t y0 = i ? a[i - 1].y + 1 : 0, l0 = i ? a[i - 1].line + 1 : 0;
+    llong_t y1 = i < na ? a[i].y : oe - p, l1 = i < na ? a[i].line : n;
+    changed += resync_rows(p + y0, y1 - y0, &lines[l0], l1 - l0);
+  }
+  free(a);
+  free(lines);
+
+  // the rows now match the file, so saves can reuse it again
+  at = buf;
+  for (llong_t y = p; y < p + n; y++) {
+    const char *nl = memchr(at, '\n', end - at);
+    llong_t raw = (nl ? nl : end) - at;
+    E.rows[y].orig = raw == E.rows[y].len ? top + (at - buf) : -1;
+    at = nl ? nl + 1 : end;
+  }
+  E.stamp = now;
+  E.tail = now.size;
+  E.tail_open = last != '\n';
+  E.tail_dev = now.dev;
+  E.tail_ino = now.ino;
+  free(w.buf);
+
+  // edits made before no longer apply to these rows
   E.dirty = 0;
+  undo_free(&E.undo);
+  if (E.journal.fd != -1)
+    journal_reset(&E.journal, now.size, now.mtime_ns);
+  if (E.cy > E.nrows)
+    E.cy = E.nrows;
+  if (E.cy < E.nrows && E.cx > E.rows[E.cy].len)
+    E.cx = E.rows[E.cy].len;
+  set_status_msg("reloaded %.40s: %lld %s changed", E.filename, changed,
+                 changed == 1 ? "row" : "rows");
+  return 1;
+
+fail: // the file changed again while being read, so wait for that to settle
+  close(fd);
+  free(w.buf);
+  return 0;
 }
 
-void quit(int tries_left, int status) {
-  if (E.dirty && tries_left) {
-    char *fmt = "UNSAVED CHANGES! (^X %d more %s to quit)";
-    char *noun = (tries_left == 1) ? "time" : "times";
-    set_status_msg(fmt, tries_left, noun);
-    return;
+/* memory */
+
+// add up the bytes held by n rows
+void count_rows(memstats *m, textrow *rows, llong_t n) {
+  m->rows += sizeof(textrow) * n;
+  for (llong_t i = 0; i < n; i++) {
+    textrow *row = &rows[i];
+    if (row->hl)
+      m->matches += sizeof(rowmatches) + sizeof(llong_t) * 2 * row->hl->cap;
+    if (row->flags & ROW_COLD) {
+      m->ncold++;
+      continue;
+    }
+    if (row->flags & ROW_LOCAL) {
+      m->local++;
+      continue;
+    }
+    if (row->flags & ROW_INTERNED) {
+      m->interned++;
+      m->saved += row->len + 1;
+      if (!(row->flags & ROW_ALIAS))
+        m->saved += row->rlen + 1;
+    }
+    if (row->flags & ROW_ARENA)
+      continue;
+    m->chars += row->len + 1;
+    if (!(row->flags & (ROW_ALIAS | ROW_UNRENDERED)))
+      m->render += row->rlen + 1;
   }
-  clear_tty();
-  exit(status);
+}
+
+// fill m with the bytes held for the buffer and its screen, walking every row
+// rather than counting as memory comes and goes so edits pay nothing for it
+void count_mem(memstats *m) {
+  memset(m, 0, sizeof(*m));
+  count_rows(m, E.rows, E.nrows);
+  if (E.snap.active && E.snap.rows != E.rows)
+    m->rows += sizeof(textrow) * E.snap.nrows;
+  if (paging()) {
+    count_rows(m, E.pager.rows, E.pager.nrows);
+    m->rows += sizeof(textrow) * (PAGER_WINDOW - E.pager.nrows);
+    m->pager = sizeof(llong_t) * E.pager.markcap + PAGER_CHUNK +
+               (E.pager.sbuf ? PAGER_CHUNK : 0);
+  }
+  m->arena = E.arena.size;
+  m->arena_used = E.arena.used;
+  m->cold = E.cold_bytes;
+  m->intern = sizeof(internslot) * E.interns.cap;
+  m->index = sizeof(rowblock) * E.nblocks;
+  m->undo = undo_bytes(&E.undo);
+  m->frame = E.frame_size;
+}
+
+// return the total of m
+ullong_t mem_total(memstats *m) {
+  return m->rows + m->chars + m->render + m->arena + m->cold + m->intern +
+         m->matches + m->index + m->undo + m->frame + m->pager;
+}
+
+// write n bytes to buf in a short human readable form
+void format_bytes(char *buf, ullong_t size, ullong_t n) {
+  const char *units = "BKMGT";
+  double v = n;
+  while (v >= 1024 && units[1]) {
+    v /= 1024;
+    units++;
+  }
+  if (*units == 'B')
+    snprintf(buf, size, "%lluB", n);
+  else
+    snprintf(buf, size, "%.1f%c", v, *units);
+}
+
+// show the memory held in the status bar, largest parts first
+void show_mem() {
+  memstats m;
+  count_mem(&m);
+  mempart parts[] = {
+      {"rows", m.rows},   {"chars", m.chars}, {"render", m.render},
+      {"arena", m.arena}, {"cold", m.cold},   {"intern", m.intern},
+      {"undo", m.undo},   {"index", m.index}, {"hl", m.matches},
+      {"frame", m.frame}, {"pager", m.pager}};
+  llong_t nparts = sizeof(parts) / sizeof(parts[0]);
+  for (llong_t i = 1; i < nparts; i++) {
+    for (llong_t j = i; j > 0 && parts[j].n > parts[j - 1].n; j--) {
+      mempart t = parts[j];
+      parts[j] = parts[j - 1];
+      parts[j - 1] = t;
+    }
+  }
+
+  char msg[256], num[32];
+  format_bytes(num, sizeof(num), mem_total(&m));
+  int len = snprintf(msg, sizeof(msg), "mem %s", num);
+  if (m.saved) {
+    format_bytes(num, sizeof(num), m.saved);
+    len += snprintf(&msg[len], sizeof(msg) - len, " (dedup saved %s)", num);
+  }
+  len += snprintf(&msg[len], sizeof(msg) - len, ":");
+  for (llong_t i = 0; i < nparts && parts[i].n; i++) {
+    format_bytes(num, sizeof(num), parts[i].n);
+    len += snprintf(&msg[len], sizeof(msg) - len, " %s %s", parts[i].name, num);
+  }
+  set_status_msg("%s", msg);
+}
+
+// print a breakdown of the memory held to fp
+void print_mem(FILE *fp) {
+  memstats m;
+  count_mem(&m);
+  fprintf(fp, "tin memory use\n");
+  fprintf(fp, "  rows     %14llu  (%lld rows, %llu holding their chars)\n",
+          m.rows, E.nrows, m.local);
+  fprintf(fp, "  chars    %14llu\n", m.chars);
+  fprintf(fp, "  render   %14llu\n", m.render);
+  fprintf(fp, "  arena    %14llu  (%llu used)\n", m.arena, m.arena_used);
+  fprintf(fp, "  cold     %14llu  (%llu rows)\n", m.cold, m.ncold);
+  fprintf(fp, "  intern   %14llu  (%llu rows shared, %llu bytes saved)\n",
+          m.intern, m.interned, m.saved);
+  fprintf(fp, "  matches  %14llu\n", m.matches);
+  fprintf(fp, "  index    %14llu\n", m.index);
+  fprintf(fp, "  undo     %14llu\n", m.undo);
+  fprintf(fp, "  frame    %14llu\n", m.frame);
+  fprintf(fp, "  pager    %14llu\n", m.pager);
+  fprintf(fp, "  total    %14llu\n", mem_total(&m));
 }
 
 /* key processing */
 
-int read_key() {
+// wait for a key and read it
+int read_keypress() {
   llong_t nread;
   char c;
-  while ((nread = read(STDIN_FILENO, &c, 1)) != 1) {
-    if (nread == -1 && errno != EAGAIN)
+  while (1) {
+    if (E.resized) {
+      E.resized = 0;
+      set_editor_size();
+      return REDRAW_KEY;
+    }
+    int ready = wait_key();
+    if (ready == -1)
+      return REDRAW_KEY; // redraw rows appended to the file
+    if (ready && (nread = E.io.read(E.io.ctx, &c)) == 1) {
+      E.key_us = now_us();
+      break;
+    }
+    if (ready && nread == -1 && errno != EAGAIN)
       die("read");
+    autosave_tick();
+    cold_tick();
   }
 
   if (c == ESC) {
@@ -946,13 +3104,14 @@ int read_key() {
 
     // read up to 3 bytes: [<char1><char2>
     // return ESC key on failure
-    if (read(STDIN_FILENO, &seq[0], 1) != 1)
+    if (E.io.read(E.io.ctx, &seq[0]) != 1)
       return ESC;
-    if (read(STDIN_FILENO, &seq[1], 1) != 1)
+    if (E.io.read(E.io.ctx, &seq[1]) != 1)
       return ESC;
 
     if (seq[0] == '[') {
-      if (seq[1] >= '0' && seq[1] <= '9' && read(STDIN_FILENO, &seq[2], 1) != 1)
+      if (seq[1] >= '0' && seq[1] <= '9' &&
+          E.io.read(E.io.ctx, &seq[2]) != 1)
         return ESC;
 
       if (seq[2] == '~') {
@@ -1003,13 +3162,71 @@ int read_key() {
   return c;
 }
 
+// return the kind of key c is, for traces, which must not record typed text
+const char *key_class(int c) {
+  if (c == REDRAW_KEY)
+    return "redraw";
+  if (c == ESC || c >= ARROW_UP)
+    return "escape";
+  if (c >= 0 && iscntrl(c))
+    return "control";
+  return "printable";
+}
+
+// read a key, tracing how long it took to arrive and what kind of key it was
+int read_key() {
+  llong_t start = now_us();
+  int c = read_keypress();
+  trace("read", start, "\"key\":\"%s\"", key_class(c));
+  return c;
+}
+
+// read a key answering a question in the status bar, redrawing meanwhile
+int read_answer() {
+  int c;
+  while ((c = read_key()) == REDRAW_KEY)
+    refresh_screen();
+  return c;
+}
+
+// run the command named by the key after ^K
+void command_key() {
+  set_status_msg("^K (m)emory (t)imings");
+  refresh_screen();
+  int c = read_answer();
+  switch (c) {
+  case 'm':
+    show_mem();
+    break;
+  case 't':
+    E.timing = !E.timing;
+    E.times.nrecent = 0;
+    set_status_msg("");
+    break;
+  default:
+    set_status_msg("");
+    break;
+  }
+}
+
 void handle_key() {
   static int quit_times = TIN_QUIT_TIMES;
+  E.waiting = 1;
+  autosave_tick();
   int c = read_key();
+  E.waiting = 0;
+  if (c == REDRAW_KEY)
+    return; // nothing to do but draw the next frame
+
+  // the pager never changes the file, so only lets through keys that read it
+  if (paging() && !pager_key(c)) {
+    set_status_msg("read-only pager");
+    return;
+  }
 
   switch (c) {
   case CTRL_KEY('x'): // quit editor
-    quit(quit_times--, 0);
+    quit(quit_times--);
     return;
   case CTRL_KEY('s'):
     write_file();
@@ -1017,6 +3234,21 @@ void handle_key() {
   case CTRL_KEY('f'):
     find();
     break;
+  case CTRL_KEY('r'):
+    replace();
+    break;
+  case CTRL_KEY('g'):
+    goto_line();
+    break;
+  case CTRL_KEY('z'):
+    undo();
+    break;
+  case CTRL_KEY('y'):
+    redo();
+    break;
+  case CTRL_KEY('k'):
+    command_key();
+    break;
 
   case RETURN:
     newline_at_cursor();
@@ -1034,7 +3266,7 @@ void handle_key() {
     break;
   case END_KEY:
     if (E.cy < E.nrows)
-      E.cx = E.rows[E.cy].len;
+      E.cx = get_row(E.cy)->len;
     break;
 
   case DEL_KEY:
@@ -1047,19 +3279,13 @@ void handle_key() {
     break;
 
   case PAGE_UP:
-  case PAGE_DOWN: {
-    if (c == PAGE_UP) {
-      E.cy = E.rowoff;
-    } else if (c == PAGE_DOWN) {
-      E.cy = E.rowoff + E.winrows - 1;
-      if (E.cy > E.nrows)
-        E.cy = E.nrows;
-    }
+  case PAGE_DOWN:
     page_cursor(c);
     break;
-  }
 
   case ESC:
+    set_query(NULL); // clear search highlighting
+    break;
   case CTRL_KEY('l'):
     break;
 
@@ -1071,34 +3297,106 @@ void handle_key() {
   quit_times = TIN_QUIT_TIMES;
 }
 
-/* run loop */
+/* library interface */
 
-void handle_winch() {
-  // TODO: does cursor position behave properly if window resize causes it to
-  // go off screen?
-  set_editor_size();
-  // TODO: we use snprintf here... is that safe for a signal handler?
-  refresh_screen();
+// set fields of o to what tin does without options
+void tin_default_opts(tin_opts *o) {
+  memset(o, 0, sizeof(*o));
+  o->sync = SAVE_SYNC_DIR;
+  o->journal = 1;
+  o->piped = -1;
+  o->trace = NULL;
 }
 
-int main(int argc, char **argv) {
-  enable_raw_tty();
-  init_config();
+// start an editor on fname (or a new buffer if NULL), reading keys from and
+// drawing to io as opts say
+// return the editor, which stays current until another is driven
+tin *tin_new(const tin_io *io, const tin_opts *opts, const char *fname) {
+  if (!(cur = calloc(1, sizeof(tin))))
+    die("malloc");
+  init_config(io);
+  E.autosave_secs = opts->autosave_secs;
+  E.sync = opts->sync;
+  E.dedup = opts->dedup;
+  if (opts->trace && trace_open(&E.trace, opts->trace) == -1)
+    REPORT_ERR("trace error");
+
+  if (opts->piped != -1) {
+    if (stream_open(&E.stream, opts->piped) == -1)
+      die("stream");
+    E.follow = 1;
+  } else if (opts->page && fname) {
+    E.filename = strdup(fname);
+    if (pager_open(&E.pager, E.filename) == -1)
+      die("open");
+  } else if (fname && open_file((char *)fname) == -1 && errno == EFBIG) {
+    // lines too long to edit can still be paged through
+    if (pager_open(&E.pager, E.filename) == -1)
+      die("open");
+    set_status_msg("lines too long to edit, paging read-only");
+  } else if (fname) {
+    if (opts->journal)
+      start_journal(1);
+    watch_path(&E.watch, E.filename); // to resync when changed on disk
+  }
 
-  if (argc >= 2) {
-    open_file(argv[1]);
+  // follow the file from its end, like tail -f
+  if (opts->follow && E.filename) {
+    E.follow = 1;
+    if (paging())
+      watch_path(&E.watch, E.filename);
+    if (!paging() && E.nrows)
+      set_cursor_row(E.nrows - 1);
   }
+  return cur;
+}
 
-  // handle terminal resize
-  struct sigaction sa;
-  sa.sa_handler = handle_winch;
-  sa.sa_flags = SA_RESTART; // restart interrupted syscalls
-  sigaction(SIGWINCH, &sa, NULL);
+// draw a frame of ed
+void tin_draw(tin *ed) {
+  cur = ed;
+  refresh_screen();
+}
 
-  while (1) {
-    refresh_screen();
-    handle_key();
-  }
+// read and handle a key, returning 1 once ed has quit or 0 if not
+int tin_key(tin *ed) {
+  cur = ed;
+  handle_key();
+  return E.quit;
+}
 
-  return 0;
+// print a breakdown of the memory ed holds to fp
+void tin_stats(tin *ed, FILE *fp) {
+  cur = ed;
+  print_mem(fp);
+}
+
+// note that the screen of ed changed size, to be redrawn once it next
+// waits for a key
+// only sets a flag, so is safe to call from a signal handler
+void tin_resize(tin *ed) { ed->resized = 1; }
+
+// free ed and everything it holds
+// a journal of unsaved edits is kept for recovery, as if tin were killed
+void tin_free(tin *ed) {
+  cur = ed;
+  autosave_finish();
+  journal_close(&E.journal, !E.dirty);
+  trace_close(&E.trace);
+  del_rows(0, E.nrows);
+  free(E.rows);
+  arena_free(&E.arena);
+  intern_free(&E.interns);
+  coldbuf_free(&E.peek);
+  free(E.peek_render);
+  free(E.filename);
+  free(E.query);
+  free(E.blocks);
+  undo_free(&E.undo);
+  pager_close(&E.pager);
+  stream_close(&E.stream);
+  watch_close(&E.watch);
+  free(E.snap.garbage);
+  pthread_mutex_destroy(&E.snap.lock);
+  free(cur);
+  cur = NULL;
 }
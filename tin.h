@@ -0,0 +1,62 @@
+#ifndef TIN_H
+#define TIN_H
+
+#include "row.h"
+#include <stdio.h>
+
+/* the editor, driven by a terminal or by a script */
+
+// one editor per process is a hard limit: each tin_* call makes its editor
+// the current one for the library, which must be driven from a single thread
+// an editor that runs out of memory or fails to read keys or its file calls
+// die(), which clears the screen, prints the error and exits the process
+// rather than returning to the caller
+
+typedef struct tin tin;
+
+// where an editor reads keys from and draws frames to
+typedef struct tin_io {
+  void *ctx; // passed to each callback
+  int fd;    // descriptor to poll for keys, or -1 if keys are always ready
+  // read a byte of input into c, returning 1, 0 if none came within about a
+  // tenth of a second, or -1 with errno set
+  llong_t (*read)(void *ctx, char *c);
+  // write len bytes at buf to the screen
+  void (*write)(void *ctx, const char *buf, llong_t len);
+  // set rows and cols to the size of the screen, returning 0 or -1
+  int (*size)(void *ctx, llong_t *rows, llong_t *cols);
+} tin_io;
+
+// how an editor opens its file, as set by tin's options
+typedef struct tin_opts {
+  int autosave_secs; // seconds between autosaves, or 0 if disabled (-a)
+  int sync;          // durability of saves, an enum save_sync (-d)
+  int page;          // set to page the file read-only (-R)
+  int follow;        // set to append rows written to the file (-f)
+  int dedup;         // set to share chars of identical rows (--dedup)
+  int journal;       // set to journal edits for crash recovery
+  int piped;         // descriptor of piped input to read as the file, or -1
+  const char *trace; // file to write a trace of events to, or NULL
+} tin_opts;
+
+// names of the save durability levels, indexed by enum save_sync
+extern const char *sync_names[];
+
+void tin_default_opts(tin_opts *o);
+
+tin *tin_new(const tin_io *io, const tin_opts *opts, const char *fname);
+
+void tin_draw(tin *ed);
+
+int tin_key(tin *ed);
+
+// print a breakdown of the memory ed holds to fp, e.g. once it has quit and
+// the terminal is back to normal
+void tin_stats(tin *ed, FILE *fp);
+
+// safe to call from a signal handler
+void tin_resize(tin *ed);
+
+void tin_free(tin *ed);
+
+#endif
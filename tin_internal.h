@@ -0,0 +1,22 @@
+#ifndef TIN_INTERNAL_H
+#define TIN_INTERNAL_H
+
+#include "row.h"
+
+/* internals of tin.c, which work on the editor last driven */
+
+// shared with the benchmarks in bench/, which time them directly
+
+void render_row(textrow *row);
+
+llong_t cx_to_rx(textrow *row, llong_t cx);
+
+llong_t rx_to_cx(textrow *row, int rx);
+
+int nplaces(llong_t n);
+
+void set_query(char *query);
+
+llong_t row_find(textrow *row, llong_t from, llong_t *mlen);
+
+#endif
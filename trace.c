@@ -0,0 +1,180 @@
+#include "trace.h"
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// events are written in chrome's trace event format, as a json array with
+// one object per line, on a single thread of a single process
+#define TRACE_FLUSH_MS 500           // max delay before an event is written
+#define TRACE_FLUSH_BYTES (1 << 20)  // pending bytes that wake the writer
+#define TRACE_MAX_PENDING (64 << 20) // events are dropped past this
+
+void trace_init(tracer *t) {
+  t->fd = -1;
+  t->pid = 0;
+  ab_init(&t->pending);
+  t->lost = 0;
+  t->stop = 0;
+}
+
+static int write_all(int fd, const char *buf, unsigned long long len) {
+  while (len) {
+    ssize_t n = write(fd, buf, len);
+    if (n == -1 && errno == EINTR)
+      continue;
+    if (n == -1)
+      return -1;
+    buf += n;
+    len -= n;
+  }
+  return 0;
+}
+
+// write pending events in batches
+// the editor only ever holds the lock long enough to append to pending
+static void *trace_writer(void *arg) {
+  tracer *t = arg;
+  abuf out;
+  ab_init(&out);
+
+  pthread_mutex_lock(&t->lock);
+  while (1) {
+    if (!t->stop && t->pending.len < TRACE_FLUSH_BYTES) {
+      struct timespec until;
+      clock_gettime(CLOCK_REALTIME, &until);
+      until.tv_nsec += TRACE_FLUSH_MS * 1000000L;
+      until.tv_sec += until.tv_nsec / 1000000000L;
+      until.tv_nsec %= 1000000000L;
+      pthread_cond_timedwait(&t->wake, &t->lock, &until);
+    }
+
+    // take the pending events, leaving an empty buffer in their place
+    abuf tmp = out;
+    out = t->pending;
+    t->pending = tmp;
+    t->pending.len = 0;
+    int stop = t->stop;
+    pthread_mutex_unlock(&t->lock);
+
+    if (out.len) {
+      write_all(t->fd, out.buf, out.len);
+      out.len = 0;
+    }
+    if (stop)
+      break;
+
+    pthread_mutex_lock(&t->lock);
+  }
+
+  ab_free(&out);
+  return NULL;
+}
+
+// start tracing to path, replacing what it held
+// return 0, or -1 with errno set
+int trace_open(tracer *t, const char *path) {
+  int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd == -1)
+    return -1;
+  char head[128];
+  t->pid = getpid();
+  int len = snprintf(head, sizeof(head),
+                     "[{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":%d,"
+                     "\"args\":{\"name\":\"tin\"}}",
+                     t->pid);
+  if (write_all(fd, head, len) == -1) {
+    int saved = errno;
+    close(fd);
+    errno = saved;
+    return -1;
+  }
+
+  t->fd = fd;
+  t->lost = 0;
+  t->stop = 0;
+  pthread_mutex_init(&t->lock, NULL);
+  pthread_cond_init(&t->wake, NULL);
+  if (pthread_create(&t->thread, NULL, trace_writer, t) != 0) {
+    close(fd);
+    trace_init(t);
+    errno = EAGAIN;
+    return -1;
+  }
+  return 0;
+}
+
+// queue an event of the given phase at microsecond at, lasting dur if a span
+// args are the members of the event's args object, or NULL for none
+static void trace_event(tracer *t, const char *name, char phase, long long at,
+                        long long dur, const char *args) {
+  if (t->fd == -1)
+    return;
+  char buf[512];
+  int len = snprintf(buf, sizeof(buf),
+                     ",\n{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%lld,", name,
+                     phase, at);
+  if (phase == 'X')
+    len += snprintf(&buf[len], sizeof(buf) - len, "\"dur\":%lld,", dur);
+  else
+    len += snprintf(&buf[len], sizeof(buf) - len, "\"s\":\"t\",");
+  len += snprintf(&buf[len], sizeof(buf) - len,
+                  "\"pid\":%d,\"tid\":1,\"args\":{%s}}", t->pid,
+                  args ? args : "");
+  if (len >= (int)sizeof(buf))
+    return; // args too long to be worth a partial event
+
+  pthread_mutex_lock(&t->lock);
+  if (t->pending.len + len > TRACE_MAX_PENDING)
+    t->lost++;
+  else
+    ab_strcat(&t->pending, buf, len);
+  if (t->pending.len >= TRACE_FLUSH_BYTES)
+    pthread_cond_signal(&t->wake);
+  pthread_mutex_unlock(&t->lock);
+}
+
+// queue an event named name lasting from microsecond start to end
+void trace_span(tracer *t, const char *name, long long start, long long end,
+                const char *args) {
+  trace_event(t, name, 'X', start, end - start, args);
+}
+
+// queue an event named name at microsecond at
+void trace_mark(tracer *t, const char *name, long long at, const char *args) {
+  trace_event(t, name, 'i', at, 0, args);
+}
+
+// write pending events, end the trace and stop tracing
+void trace_close(tracer *t) {
+  if (t->fd == -1)
+    return;
+  pthread_mutex_lock(&t->lock);
+  t->stop = 1;
+  pthread_cond_signal(&t->wake);
+  pthread_mutex_unlock(&t->lock);
+  pthread_join(t->thread, NULL);
+
+  // note how many events were dropped, at the end of the trace
+  if (t->lost) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    char lost[256];
+    int len = snprintf(lost, sizeof(lost),
+                       ",\n{\"name\":\"lost\",\"ph\":\"i\",\"ts\":%lld,"
+                       "\"s\":\"g\",\"pid\":%d,\"tid\":1,"
+                       "\"args\":{\"events\":%llu}}",
+                       ts.tv_sec * 1000000LL + ts.tv_nsec / 1000, t->pid,
+                       t->lost);
+    write_all(t->fd, lost, len);
+  }
+  write_all(t->fd, "\n]\n", 3);
+  close(t->fd);
+  ab_free(&t->pending);
+  pthread_mutex_destroy(&t->lock);
+  pthread_cond_destroy(&t->wake);
+  trace_init(t);
+}
@@ -0,0 +1,31 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include "abuf.h"
+#include <pthread.h>
+
+/* timeline of what the editor spent its time on, for chrome://tracing */
+
+typedef struct tracer {
+  int fd;                  // trace file, or -1 if not tracing
+  int pid;                 // process id the events are under
+  pthread_t thread;        // background writer
+  pthread_mutex_t lock;    // guards everything below
+  pthread_cond_t wake;     // signalled when pending fills up and on stop
+  abuf pending;            // events waiting to be written
+  unsigned long long lost; // events dropped while the writer fell behind
+  int stop;                // write pending events and exit the writer
+} tracer;
+
+void trace_init(tracer *t);
+
+int trace_open(tracer *t, const char *path);
+
+void trace_span(tracer *t, const char *name, long long start, long long end,
+                const char *args);
+
+void trace_mark(tracer *t, const char *name, long long at, const char *args);
+
+void trace_close(tracer *t);
+
+#endif
@@ -0,0 +1,32 @@
+#include "trigram.h"
+#include <string.h>
+
+// trigrams are hashed on ascii-folded bytes so one set serves both
+// case-sensitive and case-insensitive searches
+#define FOLD(c) ((unsigned char)((c) - 'A') < 26 ? (c) | 0x20 : (c))
+
+static unsigned int tri_hash(unsigned char a, unsigned char b,
+                             unsigned char c) {
+  unsigned int h = FOLD(a) | FOLD(b) << 8 | FOLD(c) << 16;
+  return (h * 0x9E3779B1u) >> 20 & (TRI_BITS - 1);
+}
+
+void tri_clear(trigrams *t) { memset(t->bits, 0, sizeof(t->bits)); }
+
+// add every trigram of s to t
+void tri_add(trigrams *t, const char *s, unsigned long long len) {
+  const unsigned char *u = (const unsigned char *)s;
+  for (unsigned long long i = 0; i + 2 < len; i++) {
+    unsigned int h = tri_hash(u[i], u[i + 1], u[i + 2]);
+    t->bits[h / 64] |= 1ULL << (h % 64);
+  }
+}
+
+// return nonzero if every trigram in sub may also be in t
+int tri_contains(const trigrams *t, const trigrams *sub) {
+  for (int i = 0; i < TRI_WORDS; i++) {
+    if (sub->bits[i] & ~t->bits[i])
+      return 0;
+  }
+  return 1;
+}
@@ -0,0 +1,19 @@
+#ifndef TRIGRAM_H
+#define TRIGRAM_H
+
+/* trigram sets for skipping text that cannot contain a search query */
+
+#define TRI_BITS 4096 // must be a power of two
+#define TRI_WORDS (TRI_BITS / 64)
+
+typedef struct trigrams {
+  unsigned long long bits[TRI_WORDS];
+} trigrams;
+
+void tri_clear(trigrams *t);
+
+void tri_add(trigrams *t, const char *s, unsigned long long len);
+
+int tri_contains(const trigrams *t, const trigrams *sub);
+
+#endif
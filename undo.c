@@ -0,0 +1,182 @@
+#include "undo.h"
+#include <string.h>
+#include <time.h>
+
+#define UNDO_MERGE_MS 1000 // pause after which typing starts a new undo step
+
+static long long now_ms() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return ts.tv_sec * 1000LL + ts.tv_nsec / 1000000;
+}
+
+// compute the position just past len bytes of s inserted at (y, x)
+static void text_end(const char *s, unsigned long long len, long long y,
+                     long long x, long long *ey, long long *ex) {
+  *ey = y;
+  *ex = x;
+  for (unsigned long long i = 0; i < len; i++) {
+    if (s[i] == '\n') {
+      (*ey)++;
+      *ex = 0;
+    } else {
+      (*ex)++;
+    }
+  }
+}
+
+void undo_init(undo_log *u) {
+  u->ops = NULL;
+  u->nops = u->cap = u->cur = 0;
+  ab_init(&u->text);
+  ab_init(&u->scratch);
+  u->group = 1;
+  u->sealed = 1;
+  u->txn = 0;
+  u->last_ms = 0;
+}
+
+// reverse len bytes of s in place
+static void reverse(char *s, unsigned long long len) {
+  for (unsigned long long i = 0; i < len / 2; i++) {
+    char c = s[i];
+    s[i] = s[len - 1 - i];
+    s[len - 1 - i] = c;
+  }
+}
+
+// append the text of an op to the arena
+// deleted text is stored reversed, so that backspacing can extend it
+static int undo_append(undo_log *u, int kind, const char *s,
+                       unsigned long long len) {
+  if (ab_strcat(&u->text, s, len) == -1)
+    return -1;
+  if (kind == UNDO_DELETE)
+    reverse(&u->text.buf[u->text.len - len], len);
+  return 0;
+}
+
+// record an edit of len bytes of s at (y, x)
+// an insert right after the last insert, or a delete right before the last
+// delete, is coalesced into the last op instead of starting a new one
+// return 0, or -1 if out of memory, leaving the log as it was
+int undo_record(undo_log *u, int kind, long long y, long long x,
+                const char *s, unsigned long long len) {
+  long long ms = now_ms();
+  if (!u->txn && ms - u->last_ms > UNDO_MERGE_MS)
+    undo_seal(u);
+  u->last_ms = ms;
+
+  // drop ops that were undone
+  if (u->cur < u->nops) {
+    u->text.len = u->ops[u->cur].off;
+    u->nops = u->cur;
+    u->sealed = 1;
+  }
+
+  long long ey, ex;
+  text_end(s, len, y, x, &ey, &ex);
+
+  undo_op *last = u->nops ? &u->ops[u->nops - 1] : NULL;
+  if (last && !u->sealed && last->kind == kind) {
+    if (kind == UNDO_INSERT && last->ey == y && last->ex == x) {
+      if (undo_append(u, kind, s, len) == -1)
+        return -1;
+      last->len += len;
+      text_end(s, len, last->ey, last->ex, &last->ey, &last->ex);
+      return 0;
+    }
+    if (kind == UNDO_DELETE && last->y == ey && last->x == ex) {
+      if (undo_append(u, kind, s, len) == -1)
+        return -1;
+      last->len += len;
+      last->y = y;
+      last->x = x;
+      return 0;
+    }
+  }
+
+  if (u->nops == u->cap) {
+    unsigned long long cap = u->cap ? u->cap * 2 : 64;
+    undo_op *ops = realloc(u->ops, sizeof(undo_op) * cap);
+    if (!ops)
+      return -1;
+    u->ops = ops;
+    u->cap = cap;
+  }
+
+  undo_op *op = &u->ops[u->nops];
+  op->kind = kind;
+  op->y = y;
+  op->x = x;
+  op->ey = ey;
+  op->ex = ex;
+  op->off = u->text.len;
+  op->len = len;
+  if (undo_append(u, kind, s, len) == -1)
+    return -1;
+  if (!u->txn && u->sealed)
+    u->group++;
+  op->group = u->group;
+  u->nops++;
+  u->cur = u->nops;
+  u->sealed = 0;
+  return 0;
+}
+
+// make the next recorded op start a new undo step
+void undo_seal(undo_log *u) { u->sealed = 1; }
+
+// group every op recorded until undo_end into one undo step
+void undo_begin(undo_log *u) {
+  undo_seal(u);
+  u->group++;
+  u->txn = 1;
+}
+
+void undo_end(undo_log *u) {
+  u->txn = 0;
+  undo_seal(u);
+}
+
+// step back over the last applied op if it is in group (or any group if
+// group is 0), returning it or NULL
+undo_op *undo_back(undo_log *u, unsigned long long group) {
+  if (!u->cur || (group && u->ops[u->cur - 1].group != group))
+    return NULL;
+  undo_seal(u);
+  return &u->ops[--u->cur];
+}
+
+// step forward over the next undone op if it is in group (or any group if
+// group is 0), returning it or NULL
+undo_op *undo_forward(undo_log *u, unsigned long long group) {
+  if (u->cur == u->nops || (group && u->ops[u->cur].group != group))
+    return NULL;
+  undo_seal(u);
+  return &u->ops[u->cur++];
+}
+
+// return the text of op in document order
+const char *undo_text(undo_log *u, undo_op *op) {
+  const char *s = &u->text.buf[op->off];
+  if (op->kind == UNDO_INSERT)
+    return s;
+  u->scratch.len = 0;
+  if (ab_strcat(&u->scratch, s, op->len) == -1)
+    return NULL;
+  reverse(u->scratch.buf, op->len);
+  return u->scratch.buf;
+}
+
+// return the number of bytes held by the log
+unsigned long long undo_bytes(undo_log *u) {
+  return u->cap * sizeof(undo_op) + u->text.size + u->scratch.size;
+}
+
+void undo_free(undo_log *u) {
+  free(u->ops);
+  ab_free(&u->text);
+  ab_free(&u->scratch);
+  undo_init(u);
+}
@@ -0,0 +1,54 @@
+#ifndef UNDO_H
+#define UNDO_H
+
+#include "abuf.h"
+
+/* undo log */
+
+#define UNDO_INSERT 0
+#define UNDO_DELETE 1
+
+typedef struct undo_op {
+  int kind;                 // UNDO_INSERT or UNDO_DELETE
+  long long y, x;           // start of the edited text
+  long long ey, ex;         // end of the edited text
+  unsigned long long off;   // offset of the text in the log's arena
+  unsigned long long len;   // length of the text, where '\n' splits rows
+  unsigned long long group; // ops in the same group are undone together
+} undo_op;
+
+typedef struct undo_log {
+  undo_op *ops;             // recorded ops, oldest first
+  unsigned long long nops;  // number of recorded ops
+  unsigned long long cap;   // capacity of ops
+  unsigned long long cur;   // number of ops currently applied
+  abuf text;                // arena holding the text of every op
+  abuf scratch;             // op text in natural order for deletions
+  unsigned long long group; // group of the next recorded op
+  int sealed;               // don't coalesce the next op with the last one
+  int txn;                  // nonzero while inside undo_begin/undo_end
+  long long last_ms;        // time of the last recorded op
+} undo_log;
+
+void undo_init(undo_log *u);
+
+int undo_record(undo_log *u, int kind, long long y, long long x,
+                const char *s, unsigned long long len);
+
+void undo_seal(undo_log *u);
+
+void undo_begin(undo_log *u);
+
+void undo_end(undo_log *u);
+
+undo_op *undo_back(undo_log *u, unsigned long long group);
+
+undo_op *undo_forward(undo_log *u, unsigned long long group);
+
+const char *undo_text(undo_log *u, undo_op *op);
+
+unsigned long long undo_bytes(undo_log *u);
+
+void undo_free(undo_log *u);
+
+#endif
@@ -0,0 +1,62 @@
+#include "watch.h"
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/inotify.h>
+#endif
+
+#define WATCH_EVENTS                                                           \
+  (IN_MODIFY | IN_ATTRIB | IN_CLOSE_WRITE | IN_MOVE_SELF | IN_DELETE_SELF)
+
+void watch_init(watch *w) { w->fd = w->wd = -1; }
+
+// watch path for changes, replacing any file watched before
+// return 0, or -1 with errno set if path cannot be watched
+int watch_path(watch *w, const char *path) {
+#ifdef __linux__
+  if (w->fd == -1 && (w->fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC)) == -1)
+    return -1;
+  if (w->wd != -1)
+    inotify_rm_watch(w->fd, w->wd);
+  w->wd = inotify_add_watch(w->fd, path, WATCH_EVENTS);
+  return w->wd == -1 ? -1 : 0;
+#else
+  (void)w;
+  (void)path;
+  errno = ENOSYS;
+  return -1;
+#endif
+}
+
+// drain the events waiting on the watch without blocking
+// return the union of the masks of those on the file watched now, or 0 if
+// there were none
+unsigned watch_read(watch *w) {
+  unsigned mask = 0;
+#ifdef __linux__
+  char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+  ssize_t n;
+  while ((n = read(w->fd, buf, sizeof(buf))) > 0) {
+    for (char *p = buf; p < buf + n;) {
+      struct inotify_event *ev = (struct inotify_event *)p;
+      // events of a watch replaced since are late, and not about the file
+      if (ev->wd == w->wd) {
+        mask |= ev->mask;
+        if (ev->mask & IN_IGNORED)
+          w->wd = -1; // the file is gone, so is its watch
+      }
+      p += sizeof(struct inotify_event) + ev->len;
+    }
+  }
+#else
+  (void)w;
+#endif
+  return mask;
+}
+
+void watch_close(watch *w) {
+  if (w->fd != -1)
+    close(w->fd);
+  watch_init(w);
+}
@@ -0,0 +1,19 @@
+#ifndef WATCH_H
+#define WATCH_H
+
+/* watching a file for changes */
+
+typedef struct watch {
+  int fd; // inotify instance, or -1
+  int wd; // watch on the file, or -1
+} watch;
+
+void watch_init(watch *w);
+
+int watch_path(watch *w, const char *path);
+
+unsigned watch_read(watch *w);
+
+void watch_close(watch *w);
+
+#endif